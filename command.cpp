@@ -0,0 +1,162 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "command.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+extern char** environ;
+
+namespace {
+
+// The shell execvp falls back to.
+char kShell[] = "/bin/sh";
+
+}  // namespace
+
+std::vector<std::string> Split(const std::string& argv, char separator) {
+  std::vector<std::string> result;
+  std::string arg;
+  bool in_quote = false;
+  for (const char* p = argv.c_str(); *p; ++p) {
+    if (*p == separator && !in_quote) {
+      if (!arg.empty()) {
+        result.push_back(arg);
+        arg.clear();
+      }
+    } else if (*p == '"') {
+      if (in_quote && *(p + 1) != separator) {
+        if (*(p + 1) == '"') {
+          arg.push_back(*p);
+          p++;
+        } else {
+          result.push_back(arg);
+          arg.clear();
+        }
+      }
+      in_quote = !in_quote;
+    } else {
+      if ((*p != ' ' && *p != '\n') || in_quote) {
+        arg.push_back(*p);
+      }
+    }
+  }
+
+  if (!arg.empty()) {
+    result.push_back(arg);
+  }
+
+  return result;
+}
+
+CommandPlan::CommandPlan(std::string command) : command_(std::move(command)) {
+  const auto args = Split(command_, ' ');
+
+  size_t arena_size = 0;
+  for (const auto& arg : args) {
+    arena_size += arg.size() + 1;
+  }
+  // Sized up front: argv_ points into the arena, so it must never reallocate.
+  arena_.resize(arena_size);
+  argv_.reserve(args.size() + 1);
+
+  char* next = arena_.data();
+  for (const auto& arg : args) {
+    argv_.push_back(next);
+    next = std::copy(arg.begin(), arg.end(), next);
+    *next++ = '\0';
+  }
+  argv_.push_back(nullptr);
+}
+
+PathResolver::PathResolver() {
+  const char* path = getenv("PATH");
+  // The same default as glibc's execvp.
+  std::string value = path ? path : "/bin:/usr/bin";
+  size_t start = 0;
+  while (true) {
+    auto end = value.find(':', start);
+    auto dir = value.substr(start, end - start);
+    // An empty entry means the current directory.
+    dirs_.push_back(dir.empty() ? "." : dir);
+    if (end == std::string::npos) {
+      break;
+    }
+    start = end + 1;
+  }
+}
+
+namespace {
+
+// 0 if path is an executable regular file, otherwise the errno execve would
+// report for it.
+int CheckExecutable(const std::string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return errno;
+  }
+  if (!S_ISREG(st.st_mode) || access(path.c_str(), X_OK) != 0) {
+    return EACCES;
+  }
+  return 0;
+}
+
+}  // namespace
+
+int PathResolver::Resolve(const std::string& program, std::string* path) {
+  auto it = cache_.find(program);
+  if (it == cache_.end()) {
+    std::pair<int, std::string> result{ENOENT, ""};
+    if (program.find('/') != std::string::npos) {
+      result = {CheckExecutable(program), program};
+    } else {
+      // Like execvp: the first executable match wins, and EACCES is reported
+      // over ENOENT if some match was found but could not be run.
+      bool denied = false;
+      for (const auto& dir : dirs_) {
+        auto candidate = dir + "/" + program;
+        int error = CheckExecutable(candidate);
+        if (error == 0) {
+          result = {0, candidate};
+          break;
+        }
+        denied = denied || error == EACCES;
+      }
+      if (result.first != 0 && denied) {
+        result.first = EACCES;
+      }
+    }
+    it = cache_.emplace(program, std::move(result)).first;
+  }
+
+  *path = it->second.second;
+  return it->second.first;
+}
+
+int CommandPlan::Resolve(PathResolver& resolver) {
+  envp_ = environ;
+  const int error = resolver.Resolve(argv_[0], &path_);
+  if (error != 0) {
+    return error;
+  }
+  shell_path_.assign(path_.c_str(), path_.c_str() + path_.size() + 1);
+  shell_argv_ = {kShell, shell_path_.data()};
+  shell_argv_.insert(shell_argv_.end(), argv_.begin() + 1, argv_.end());
+  return 0;
+}
@@ -0,0 +1,85 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Tokenizing commands into the argv handed to exec.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Split the command line arguments by separator.
+// If we have a "quoted string", we will treat it as a single argument.
+std::vector<std::string> Split(const std::string& argv, char separator);
+
+// Looks programs up in $PATH the way execvp does, once per distinct name.
+class PathResolver {
+ public:
+  // Takes a snapshot of $PATH.
+  PathResolver();
+
+  // Stores the path to exec for program and returns 0, or returns the errno
+  // execvp would have failed with.
+  int Resolve(const std::string& program, std::string* path);
+
+ private:
+  std::vector<std::string> dirs_;
+  // program -> (errno, path)
+  std::unordered_map<std::string, std::pair<int, std::string>> cache_;
+};
+
+// A command tokenized once in the parent, before any launch. The arguments
+// live in one contiguous arena and argv() points into it, so a child only has
+// to exec. Immutable after Resolve(); moving keeps argv() valid.
+class CommandPlan {
+ public:
+  explicit CommandPlan(std::string command);
+
+  CommandPlan(CommandPlan&&) = default;
+  CommandPlan& operator=(CommandPlan&&) = default;
+  CommandPlan(const CommandPlan&) = delete;
+  CommandPlan& operator=(const CommandPlan&) = delete;
+
+  // The command as given on the command line.
+  const std::string& command() const { return command_; }
+
+  // nullptr-terminated, as expected by exec.
+  char* const* argv() const { return argv_.data(); }
+
+  bool empty() const { return argv_.size() == 1; }
+
+  // Finds the executable for argv[0] and captures the environment, so that
+  // children can execve() without walking $PATH. Returns 0 or an errno.
+  int Resolve(PathResolver& resolver);
+
+  // Valid after a successful Resolve().
+  const char* path() const { return path_.c_str(); }
+  char* const* envp() const { return envp_; }
+  // /bin/sh, path(), then the arguments: what execvp runs instead when the
+  // kernel does not recognize the file's format (ENOEXEC), such as a script
+  // without a #! line.
+  char* const* shell_argv() const { return shell_argv_.data(); }
+
+ private:
+  std::string command_;
+  std::vector<char> arena_;
+  std::vector<char*> argv_;
+  std::string path_;
+  char* const* envp_ = nullptr;
+  // A copy of path_, since a moved string may not keep its buffer.
+  std::vector<char> shell_path_;
+  std::vector<char*> shell_argv_;
+};
@@ -0,0 +1,515 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "compare.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace {
+
+// Just enough JSON to read back what WriteJson() writes.
+struct JsonValue {
+  enum class Type { kNull, kBool, kNumber, kString, kArray, kObject };
+  Type type = Type::kNull;
+  // The literal of a number or a bool, the contents of a string.
+  std::string text;
+  std::vector<JsonValue> items;
+  std::vector<std::pair<std::string, JsonValue>> members;
+
+  // The member named key of an object, or nullptr.
+  const JsonValue* Find(const std::string& key) const {
+    for (const auto& [name, value] : members) {
+      if (name == key) {
+        return &value;
+      }
+    }
+    return nullptr;
+  }
+};
+
+class JsonParser {
+ public:
+  explicit JsonParser(const std::string& text) : text_(text) {}
+
+  // Parses the whole text as a single value.
+  bool Parse(JsonValue* value, std::string* error) {
+    if (!ParseValue(value, 0)) {
+      *error = error_;
+      return false;
+    }
+    SkipSpace();
+    if (pos_ != text_.size()) {
+      *error = Error("trailing characters");
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  // Summaries nest four deep; anything much deeper is not one.
+  static constexpr int kMaxDepth = 64;
+
+  std::string Error(const char* what) const {
+    return std::string(what) + " at offset " + std::to_string(pos_);
+  }
+
+  bool Fail(const char* what) {
+    error_ = Error(what);
+    return false;
+  }
+
+  void SkipSpace() {
+    while (pos_ < text_.size() &&
+           (text_[pos_] == ' ' || text_[pos_] == '\t' ||
+            text_[pos_] == '\r' || text_[pos_] == '\n')) {
+      ++pos_;
+    }
+  }
+
+  bool Consume(char c) {
+    SkipSpace();
+    if (pos_ < text_.size() && text_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  bool ParseValue(JsonValue* value, int depth) {
+    if (depth > kMaxDepth) {
+      return Fail("nested too deep");
+    }
+    SkipSpace();
+    if (pos_ == text_.size()) {
+      return Fail("unexpected end");
+    }
+    const char c = text_[pos_];
+    if (c == '{') {
+      return ParseObject(value, depth);
+    }
+    if (c == '[') {
+      return ParseArray(value, depth);
+    }
+    if (c == '"') {
+      value->type = JsonValue::Type::kString;
+      return ParseString(&value->text);
+    }
+    for (const char* literal : {"true", "false", "null"}) {
+      if (text_.compare(pos_, strlen(literal), literal) == 0) {
+        value->type = literal[0] == 'n' ? JsonValue::Type::kNull
+                                        : JsonValue::Type::kBool;
+        value->text = literal;
+        pos_ += strlen(literal);
+        return true;
+      }
+    }
+    return ParseNumber(value);
+  }
+
+  bool ParseObject(JsonValue* value, int depth) {
+    value->type = JsonValue::Type::kObject;
+    ++pos_;
+    if (Consume('}')) {
+      return true;
+    }
+    do {
+      SkipSpace();
+      std::string key;
+      if (pos_ == text_.size() || text_[pos_] != '"' || !ParseString(&key)) {
+        return error_.empty() ? Fail("expected a member name") : false;
+      }
+      if (!Consume(':')) {
+        return Fail("expected ':'");
+      }
+      value->members.emplace_back(std::move(key), JsonValue());
+      if (!ParseValue(&value->members.back().second, depth + 1)) {
+        return false;
+      }
+    } while (Consume(','));
+    return Consume('}') || Fail("expected ',' or '}'");
+  }
+
+  bool ParseArray(JsonValue* value, int depth) {
+    value->type = JsonValue::Type::kArray;
+    ++pos_;
+    if (Consume(']')) {
+      return true;
+    }
+    do {
+      value->items.emplace_back();
+      if (!ParseValue(&value->items.back(), depth + 1)) {
+        return false;
+      }
+    } while (Consume(','));
+    return Consume(']') || Fail("expected ',' or ']'");
+  }
+
+  // Code points from \u escapes are written as UTF-8; surrogate pairs are
+  // not joined, as no summary has any.
+  bool ParseString(std::string* out) {
+    ++pos_;
+    while (pos_ < text_.size()) {
+      const char c = text_[pos_++];
+      if (c == '"') {
+        return true;
+      }
+      if (c != '\\') {
+        *out += c;
+        continue;
+      }
+      if (pos_ == text_.size()) {
+        break;
+      }
+      const char escaped = text_[pos_++];
+      switch (escaped) {
+        case '"':
+        case '\\':
+        case '/':
+          *out += escaped;
+          break;
+        case 'b':
+          *out += '\b';
+          break;
+        case 'f':
+          *out += '\f';
+          break;
+        case 'n':
+          *out += '\n';
+          break;
+        case 'r':
+          *out += '\r';
+          break;
+        case 't':
+          *out += '\t';
+          break;
+        case 'u': {
+          if (pos_ + 4 > text_.size()) {
+            return Fail("truncated \\u escape");
+          }
+          unsigned code = 0;
+          for (int i = 0; i < 4; ++i) {
+            const char digit = text_[pos_++];
+            if (!isxdigit(static_cast<unsigned char>(digit))) {
+              return Fail("bad \\u escape");
+            }
+            code = code * 16 +
+                   (isdigit(static_cast<unsigned char>(digit))
+                        ? digit - '0'
+                        : tolower(static_cast<unsigned char>(digit)) - 'a' +
+                              10);
+          }
+          if (code < 0x80) {
+            *out += static_cast<char>(code);
+          } else if (code < 0x800) {
+            *out += static_cast<char>(0xc0 | (code >> 6));
+            *out += static_cast<char>(0x80 | (code & 0x3f));
+          } else {
+            *out += static_cast<char>(0xe0 | (code >> 12));
+            *out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            *out += static_cast<char>(0x80 | (code & 0x3f));
+          }
+          break;
+        }
+        default:
+          return Fail("bad escape");
+      }
+    }
+    return Fail("unterminated string");
+  }
+
+  // Keeps the literal, so that 64 bit integers are not rounded through a
+  // double.
+  bool ParseNumber(JsonValue* value) {
+    const size_t start = pos_;
+    while (pos_ < text_.size() &&
+           (isdigit(static_cast<unsigned char>(text_[pos_])) ||
+            text_[pos_] == '-' || text_[pos_] == '+' || text_[pos_] == '.' ||
+            text_[pos_] == 'e' || text_[pos_] == 'E')) {
+      ++pos_;
+    }
+    if (pos_ == start) {
+      return Fail("unexpected character");
+    }
+    value->type = JsonValue::Type::kNumber;
+    value->text = text_.substr(start, pos_ - start);
+    return true;
+  }
+
+  const std::string& text_;
+  size_t pos_ = 0;
+  std::string error_;
+};
+
+bool ReadUnsigned(const JsonValue& value, uint64_t* out) {
+  if (value.type != JsonValue::Type::kNumber || value.text[0] == '-') {
+    return false;
+  }
+  char* end = nullptr;
+  errno = 0;
+  *out = strtoull(value.text.c_str(), &end, 10);
+  return errno == 0 && *end == '\0';
+}
+
+// A row of WriteJson(): its name and the buckets of its response times.
+bool ReadSample(const JsonValue& row, LatencySample* sample,
+                std::string* error) {
+  const JsonValue* name = row.Find("name");
+  if (!name || name->type != JsonValue::Type::kString) {
+    *error = "a row has no name";
+    return false;
+  }
+  sample->name = name->text;
+  const JsonValue* response = row.Find("response");
+  const JsonValue* buckets = response ? response->Find("buckets") : nullptr;
+  if (!buckets || buckets->type != JsonValue::Type::kArray) {
+    *error = "'" + sample->name + "' has no response buckets";
+    return false;
+  }
+  for (const auto& item : buckets->items) {
+    Bucket bucket;
+    uint64_t high = 0;
+    if (item.type != JsonValue::Type::kArray || item.items.size() != 2 ||
+        !ReadUnsigned(item.items[0], &high) ||
+        !ReadUnsigned(item.items[1], &bucket.count)) {
+      *error = "'" + sample->name + "' has a bad bucket";
+      return false;
+    }
+    bucket.high = static_cast<int64_t>(high);
+    if (!sample->buckets.empty() &&
+        sample->buckets.back().high >= bucket.high) {
+      *error = "'" + sample->name + "' has buckets out of order";
+      return false;
+    }
+    sample->buckets.push_back(bucket);
+  }
+  return true;
+}
+
+// The "distribution" and "relative_error" of the metadata, if there.
+Resolution ReadResolution(const JsonValue& root) {
+  Resolution resolution;
+  const JsonValue* metadata = root.Find("metadata");
+  if (!metadata) {
+    return resolution;
+  }
+  const JsonValue* distribution = metadata->Find("distribution");
+  const JsonValue* error = metadata->Find("relative_error");
+  if (distribution && distribution->type == JsonValue::Type::kString &&
+      error && error->type == JsonValue::Type::kNumber) {
+    resolution.distribution = distribution->text;
+    resolution.relative_error = strtod(error->text.c_str(), nullptr);
+  }
+  return resolution;
+}
+
+std::string Describe(const Resolution& resolution) {
+  std::ostringstream out;
+  out << resolution.distribution << " within "
+      << resolution.relative_error * 100 << "%";
+  return out.str();
+}
+
+uint64_t Count(const std::vector<Bucket>& buckets) {
+  uint64_t count = 0;
+  for (const auto& bucket : buckets) {
+    count += bucket.count;
+  }
+  return count;
+}
+
+// The high of the bucket holding the value at that percentile, 0 if empty.
+int64_t ValueAtPercentile(const std::vector<Bucket>& buckets, uint64_t count,
+                          double percentile) {
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(percentile / 100 * count)));
+  uint64_t seen = 0;
+  for (const auto& bucket : buckets) {
+    seen += bucket.count;
+    if (seen >= rank) {
+      return bucket.high;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+Resolution ResolutionOf(DistributionKind kind, int precision) {
+  const auto distribution = CreateDistribution(kind, precision);
+  return {distribution->name(), distribution->RelativeError()};
+}
+
+bool SameResolution(const Resolution& base, const Resolution& current,
+                    std::string* error) {
+  if (base.distribution.empty() || current.distribution.empty()) {
+    return true;
+  }
+  // The metadata keeps six significant digits of the error.
+  if (base.distribution == current.distribution &&
+      std::abs(base.relative_error - current.relative_error) <=
+          1e-4 * std::max(base.relative_error, current.relative_error)) {
+    return true;
+  }
+  *error = "the baseline was recorded by a " + Describe(base) +
+           " and the new run by a " + Describe(current);
+  return false;
+}
+
+bool ReadJsonSummary(std::istream& in, std::vector<LatencySample>* samples,
+                     Resolution* resolution, std::string* error) {
+  const std::string text{std::istreambuf_iterator<char>(in),
+                         std::istreambuf_iterator<char>()};
+  if (in.bad()) {
+    *error = "read failed";
+    return false;
+  }
+  JsonValue root;
+  if (!JsonParser(text).Parse(&root, error)) {
+    return false;
+  }
+  const JsonValue* commands = root.Find("commands");
+  const JsonValue* all = root.Find("all");
+  if (!commands || commands->type != JsonValue::Type::kArray || !all) {
+    *error = "not a summary written by --output-format=json";
+    return false;
+  }
+  *resolution = ReadResolution(root);
+  samples->clear();
+  for (const auto& row : commands->items) {
+    samples->emplace_back();
+    if (!ReadSample(row, &samples->back(), error)) {
+      return false;
+    }
+  }
+  samples->emplace_back();
+  if (!ReadSample(*all, &samples->back(), error)) {
+    return false;
+  }
+  // Samples are matched by name.
+  std::unordered_set<std::string> names;
+  for (const auto& sample : *samples) {
+    if (!names.insert(sample.name).second) {
+      *error = "'" + sample.name + "' names more than one row";
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<LatencySample> LatencySamples(const std::vector<ReportRow>& rows,
+                                          const ReportRow& all) {
+  std::vector<LatencySample> samples;
+  for (const auto& row : rows) {
+    samples.push_back({row.name, row.stats.response.distribution->Buckets()});
+  }
+  samples.push_back({all.name, all.stats.response.distribution->Buckets()});
+  return samples;
+}
+
+Comparison Compare(const std::string& name, const std::vector<Bucket>& base,
+                   const std::vector<Bucket>& current,
+                   const ComparisonOptions& options) {
+  Comparison comparison;
+  comparison.name = name;
+  comparison.base_count = Count(base);
+  comparison.new_count = Count(current);
+  comparison.base_p50_us = ValueAtPercentile(base, comparison.base_count, 50);
+  comparison.new_p50_us = ValueAtPercentile(current, comparison.new_count, 50);
+  comparison.base_p99_us = ValueAtPercentile(base, comparison.base_count, 99);
+  comparison.new_p99_us = ValueAtPercentile(current, comparison.new_count, 99);
+  if (comparison.base_count == 0 || comparison.new_count == 0) {
+    return comparison;
+  }
+
+  // Walk both sides in value order. U counts, for every new value, the base
+  // values below it, and half of those in the same bucket.
+  double u = 0;
+  double ties = 0;
+  uint64_t base_below = 0;
+  for (size_t i = 0, j = 0; i < base.size() || j < current.size();) {
+    const int64_t high =
+        std::min(i < base.size() ? base[i].high : INT64_MAX,
+                 j < current.size() ? current[j].high : INT64_MAX);
+    const double in_base =
+        i < base.size() && base[i].high == high ? base[i++].count : 0;
+    const double in_current =
+        j < current.size() && current[j].high == high ? current[j++].count : 0;
+    u += in_current * (base_below + in_base / 2);
+    const double tied = in_base + in_current;
+    ties += tied * tied * tied - tied;
+    base_below += in_base;
+  }
+
+  const double n1 = comparison.base_count;
+  const double n2 = comparison.new_count;
+  const double n = n1 + n2;
+  comparison.slower = u / (n1 * n2);
+  const double variance = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+  if (variance > 0) {
+    // With a continuity correction.
+    const double z =
+        std::max(0.0, std::abs(u - n1 * n2 / 2) - 0.5) / std::sqrt(variance);
+    comparison.p_value = std::erfc(z / std::sqrt(2.0));
+  }
+
+  const double shift_percent =
+      comparison.base_p50_us > 0
+          ? 100.0 * (comparison.new_p50_us - comparison.base_p50_us) /
+                comparison.base_p50_us
+          : 0;
+  if (comparison.p_value < options.alpha) {
+    comparison.regression = comparison.slower > 0.5 &&
+                            shift_percent >= options.threshold_percent;
+    comparison.improvement = comparison.slower < 0.5 &&
+                             -shift_percent >= options.threshold_percent;
+  }
+  return comparison;
+}
+
+std::vector<Comparison> CompareSamples(
+    const std::vector<LatencySample>& base,
+    const std::vector<LatencySample>& current,
+    const ComparisonOptions& options, std::vector<std::string>* unmatched) {
+  std::unordered_map<std::string, const LatencySample*> base_by_name;
+  for (const auto& sample : base) {
+    base_by_name.emplace(sample.name, &sample);
+  }
+  std::vector<Comparison> comparisons;
+  for (const auto& sample : current) {
+    auto it = base_by_name.find(sample.name);
+    if (it == base_by_name.end()) {
+      unmatched->push_back(sample.name);
+      continue;
+    }
+    comparisons.push_back(
+        Compare(sample.name, it->second->buckets, sample.buckets, options));
+    base_by_name.erase(it);
+  }
+  for (const auto& sample : base) {
+    if (base_by_name.count(sample.name)) {
+      unmatched->push_back(sample.name);
+    }
+  }
+  return comparisons;
+}
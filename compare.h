@@ -0,0 +1,105 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Tells whether the latencies of a run differ from those of a baseline by
+// more than chance, for gating releases on a comparison of two runs.
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "distribution.h"
+#include "report.h"
+
+// The response times of one command, or of all of them, as buckets.
+struct LatencySample {
+  std::string name;
+  std::vector<Bucket> buckets;
+};
+
+// How the latencies of a summary were bucketed. Summaries bucketed
+// differently cannot be compared: values that share a bucket on one side
+// may be apart on the other, so the test would see ties and shifts that
+// come from the bucketing alone.
+struct Resolution {
+  // Empty if the summary does not say.
+  std::string distribution;
+  double relative_error = 0;
+};
+
+// The resolution of a run that records its latencies in a distribution of
+// that kind and precision.
+Resolution ResolutionOf(DistributionKind kind, int precision);
+
+// Whether summaries of these resolutions can be compared. Returns false and
+// describes the difference in error if both say how they were bucketed and
+// they differ.
+bool SameResolution(const Resolution& base, const Resolution& current,
+                    std::string* error);
+
+// The "commands" of a summary written with --output-format=json, then its
+// "all" row, and the resolution its metadata gives. Returns false and
+// describes the problem in error if the input is not such a summary.
+bool ReadJsonSummary(std::istream& in, std::vector<LatencySample>* samples,
+                     Resolution* resolution, std::string* error);
+
+// The rows of a run, then all, in the form ReadJsonSummary() returns.
+std::vector<LatencySample> LatencySamples(const std::vector<ReportRow>& rows,
+                                          const ReportRow& all);
+
+struct ComparisonOptions {
+  // Largest two sided p-value at which a difference counts.
+  double alpha = 0.01;
+  // Smallest change of the median, in percent, that counts as a regression
+  // or an improvement, so that significant but negligible shifts do not fail
+  // a run.
+  double threshold_percent = 0;
+};
+
+struct Comparison {
+  std::string name;
+  uint64_t base_count = 0;
+  uint64_t new_count = 0;
+  int64_t base_p50_us = 0;
+  int64_t new_p50_us = 0;
+  int64_t base_p99_us = 0;
+  int64_t new_p99_us = 0;
+  // The chance that an invocation of the new run takes longer than one of
+  // the baseline, ties counted half: the Mann-Whitney U over n1 * n2. 0.5
+  // when neither is slower.
+  double slower = 0.5;
+  // Two sided p-value of the Mann-Whitney U test, from the normal
+  // approximation with a correction for ties. 1 when either side is empty.
+  double p_value = 1;
+  bool regression = false;
+  bool improvement = false;
+};
+
+// Compares the response times of a command in two runs. Values that share a
+// bucket are taken as ties, so the test cannot see shifts smaller than the
+// buckets' relative error.
+Comparison Compare(const std::string& name, const std::vector<Bucket>& base,
+                   const std::vector<Bucket>& current,
+                   const ComparisonOptions& options);
+
+// Compares every sample of current with the baseline sample of the same
+// name, in the order of current. Names found on one side only are appended
+// to unmatched.
+std::vector<Comparison> CompareSamples(
+    const std::vector<LatencySample>& base,
+    const std::vector<LatencySample>& current,
+    const ComparisonOptions& options, std::vector<std::string>* unmatched);
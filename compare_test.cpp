@@ -0,0 +1,234 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "compare.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "report.h"
+#include "test_util.h"
+
+namespace {
+
+// Two sided p-values below are from the normal approximation with
+// continuity and tie corrections, as scipy's mannwhitneyu(method=
+// "asymptotic") computes them.
+
+void TestSeparatedSamples() {
+  // Every new value is above every baseline value: U = n1 * n2 = 9.
+  const auto comparison = Compare("c", {{1, 1}, {2, 1}, {3, 1}},
+                                  {{4, 1}, {5, 1}, {6, 1}}, {});
+  CHECK(comparison.base_count == 3);
+  CHECK(comparison.new_count == 3);
+  CHECK_NEAR(comparison.slower, 1.0, 1e-12);
+  CHECK_NEAR(comparison.p_value, 0.0808555983700523, 1e-12);
+  // Not significant at the default alpha of 0.01.
+  CHECK(!comparison.regression);
+  CHECK(!comparison.improvement);
+
+  ComparisonOptions lenient;
+  lenient.alpha = 0.1;
+  CHECK(Compare("c", {{1, 1}, {2, 1}, {3, 1}}, {{4, 1}, {5, 1}, {6, 1}},
+                lenient)
+            .regression);
+  CHECK(Compare("c", {{4, 1}, {5, 1}, {6, 1}}, {{1, 1}, {2, 1}, {3, 1}},
+                lenient)
+            .improvement);
+}
+
+void TestTies() {
+  // Baseline {1, 1, 2, 3}, new {2, 3, 3, 4}: U = 2.5 + 3.5 + 3.5 + 4 = 13.5
+  // and the tie groups of 2, 2, 3 and 1 values take 36 off the variance.
+  const auto comparison = Compare("c", {{1, 2}, {2, 1}, {3, 1}},
+                                  {{2, 1}, {3, 2}, {4, 1}}, {});
+  CHECK_NEAR(comparison.slower, 13.5 / 16, 1e-12);
+  CHECK_NEAR(comparison.p_value, 0.13416918012812581, 1e-12);
+  CHECK(comparison.base_p50_us == 1);
+  CHECK(comparison.new_p50_us == 3);
+}
+
+void TestIdenticalInputs() {
+  // All in one bucket: every pair is a tie and there is no variance.
+  auto comparison = Compare("c", {{100, 10}}, {{100, 10}}, {});
+  CHECK_NEAR(comparison.slower, 0.5, 1e-12);
+  CHECK(comparison.p_value == 1);
+  CHECK(!comparison.regression && !comparison.improvement);
+
+  const std::vector<Bucket> buckets = {{10, 5}, {20, 50}, {30, 5}};
+  comparison = Compare("c", buckets, buckets, {});
+  CHECK_NEAR(comparison.slower, 0.5, 1e-12);
+  CHECK(comparison.p_value == 1);
+  CHECK(!comparison.regression && !comparison.improvement);
+}
+
+void TestEmptySide() {
+  const auto comparison = Compare("c", {}, {{100, 10}}, {});
+  CHECK(comparison.p_value == 1);
+  CHECK(comparison.new_count == 10);
+  CHECK(!comparison.regression);
+}
+
+void TestThreshold() {
+  // A 5% shift of a large sample is highly significant.
+  const std::vector<Bucket> base = {{100, 1000}, {110, 1000}};
+  const std::vector<Bucket> current = {{105, 1000}, {115, 1000}};
+  CHECK(Compare("c", base, current, {}).regression);
+  ComparisonOptions options;
+  options.threshold_percent = 10;
+  const auto comparison = Compare("c", base, current, options);
+  CHECK(comparison.p_value < 1e-6);
+  CHECK(!comparison.regression);
+}
+
+void TestCompareSamples() {
+  const std::vector<LatencySample> base = {
+      {"a", {{10, 1}}}, {"gone", {{10, 1}}}, {"all", {{10, 2}}}};
+  const std::vector<LatencySample> current = {
+      {"new", {{10, 1}}}, {"a", {{10, 1}}}, {"all", {{10, 2}}}};
+  std::vector<std::string> unmatched;
+  const auto comparisons = CompareSamples(base, current, {}, &unmatched);
+  CHECK(comparisons.size() == 2);
+  CHECK(comparisons.size() == 2 && comparisons[0].name == "a" &&
+        comparisons[1].name == "all");
+  CHECK((unmatched == std::vector<std::string>{"new", "gone"}));
+}
+
+// What WriteJson() writes reads back as the same buckets.
+void TestJsonRoundTrip() {
+  ReportRow row{"quoted \"name\"\té", CommandStats()};
+  for (long long value : {150, 150, 2500, 40000}) {
+    row.stats.service.Record(value);
+    row.stats.response.Record(value);
+  }
+  ReportRow all{"all", row.stats};
+  std::ostringstream out;
+  WriteJson(out, RunInfo(), {row}, all);
+
+  std::istringstream in(out.str());
+  std::vector<LatencySample> samples;
+  Resolution resolution;
+  std::string error;
+  CHECK(ReadJsonSummary(in, &samples, &resolution, &error));
+  CHECK(error.empty());
+  CHECK(resolution.distribution == "histogram");
+  CHECK(SameResolution(resolution,
+                       ResolutionOf(DistributionKind::kHistogram,
+                                    kDefaultPrecision),
+                       &error));
+  CHECK(samples.size() == 2);
+  if (samples.size() == 2) {
+    CHECK(samples[0].name == row.name);
+    CHECK(samples[1].name == "all");
+    const auto expected = row.stats.response.distribution->Buckets();
+    CHECK(samples[0].buckets.size() == expected.size());
+    for (size_t i = 0;
+         i < std::min(expected.size(), samples[0].buckets.size()); ++i) {
+      CHECK(samples[0].buckets[i].high == expected[i].high);
+      CHECK(samples[0].buckets[i].count == expected[i].count);
+    }
+  }
+}
+
+// Returns the error ReadJsonSummary() reports for text, or "" if it
+// accepted it.
+std::string ReadError(const std::string& text) {
+  std::istringstream in(text);
+  std::vector<LatencySample> samples;
+  Resolution resolution;
+  std::string error;
+  if (ReadJsonSummary(in, &samples, &resolution, &error)) {
+    return "";
+  }
+  CHECK(!error.empty());
+  return error;
+}
+
+void TestParseErrors() {
+  const std::string row =
+      R"({"name": "a", "response": {"count": 2, "buckets": [[1, 1], [2, 1]]}})";
+  const std::string all =
+      R"({"name": "all", "response": {"buckets": [[1, 1], [2, 1]]}})";
+  CHECK(ReadError(R"({"commands": [)" + row + R"(], "all": )" + all + "}") ==
+        "");
+
+  for (const char* malformed :
+       {"", "{", "[1, 2", R"({"commands": [}, "all": {}})", "{} x",
+        R"({"a": "unterminated})", R"({"a": "\q"})", R"({"a": tru})",
+        R"({"a" 1})"}) {
+    CHECK(ReadError(malformed) != "");
+  }
+  // Deeply nested input is refused rather than recursed into.
+  CHECK(ReadError(std::string(100000, '[')).find("nested") !=
+        std::string::npos);
+
+  // Valid JSON that is not a summary.
+  CHECK(ReadError(R"({"a": 1})").find("not a summary") != std::string::npos);
+  CHECK(ReadError(R"({"commands": {}, "all": {}})") != "");
+  CHECK(ReadError(R"({"commands": [{"response": {"buckets": []}}], "all": )" +
+                  all + "}")
+            .find("no name") != std::string::npos);
+  CHECK(ReadError(R"({"commands": [{"name": "a"}], "all": )" + all + "}")
+            .find("no response buckets") != std::string::npos);
+  CHECK(ReadError(R"({"commands": [], "all": {"name": "all", "response": )"
+                  R"({"buckets": [[1]]}}})")
+            .find("bad bucket") != std::string::npos);
+  CHECK(ReadError(R"({"commands": [], "all": {"name": "all", "response": )"
+                  R"({"buckets": [[1, -2]]}}})")
+            .find("bad bucket") != std::string::npos);
+  CHECK(ReadError(R"({"commands": [], "all": {"name": "all", "response": )"
+                  R"({"buckets": [[2, 1], [1, 1]]}}})")
+            .find("out of order") != std::string::npos);
+  // A command row named like the row of all of them.
+  CHECK(ReadError(R"({"commands": [{"name": "all", "response": )"
+                  R"({"buckets": []}}], "all": {"name": "all", "response": )"
+                  R"({"buckets": []}}})")
+            .find("more than one row") != std::string::npos);
+}
+
+// Buckets of another distribution, or of another precision, do not line up.
+void TestResolution() {
+  const auto histogram = ResolutionOf(DistributionKind::kHistogram, 3);
+  const auto sketch = ResolutionOf(DistributionKind::kSketch, 3);
+  std::string error;
+  CHECK(SameResolution(histogram, histogram, &error));
+  CHECK(error.empty());
+  CHECK(!SameResolution(histogram, sketch, &error));
+  CHECK(error.find("sketch") != std::string::npos);
+  CHECK(!SameResolution(histogram,
+                        ResolutionOf(DistributionKind::kHistogram, 2),
+                        &error));
+  // Rounded to six significant digits, as in the metadata.
+  CHECK(SameResolution(histogram,
+                       {"histogram", histogram.relative_error * (1 + 1e-6)},
+                       &error));
+  // Summaries that do not say are compared with anything.
+  CHECK(SameResolution(Resolution(), sketch, &error));
+}
+
+}  // namespace
+
+int main() {
+  TestSeparatedSamples();
+  TestTies();
+  TestIdenticalInputs();
+  TestEmptySide();
+  TestThreshold();
+  TestCompareSamples();
+  TestJsonRoundTrip();
+  TestParseErrors();
+  TestResolution();
+  return TestStatus();
+}
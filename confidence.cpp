@@ -0,0 +1,142 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "confidence.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Two sided 95% quantile of the standard normal distribution.
+constexpr double kZ = 1.959963984540054;
+
+// Recompute the p99 interval after the sample count grows by 1/kCheckEvery.
+constexpr size_t kCheckEvery = 32;
+
+}  // namespace
+
+const char* TargetStatisticName(TargetStatistic statistic) {
+  switch (statistic) {
+    case TargetStatistic::kMean:
+      return "mean";
+    case TargetStatistic::kP99:
+      return "p99";
+  }
+  return "unknown";
+}
+
+bool ParseTargetStatistic(const std::string& name,
+                          TargetStatistic* statistic) {
+  for (auto candidate : {TargetStatistic::kMean, TargetStatistic::kP99}) {
+    if (name == TargetStatisticName(candidate)) {
+      *statistic = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+ConfidenceTarget::ConfidenceTarget(size_t plans,
+                                   const ConfidenceOptions& options,
+                                   DistributionKind kind, int precision)
+    : options_(options) {
+  for (size_t plan = 0; plan < plans; ++plan) {
+    plans_.push_back(std::make_unique<PlanState>());
+    plans_.back()->distribution = CreateDistribution(kind, precision);
+  }
+}
+
+bool ConfidenceTarget::Admit(size_t plan) {
+  auto& state = *plans_[plan];
+  if (state.done.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.launched >= options_.max_iterations) {
+    state.done = true;
+    return false;
+  }
+  state.launched++;
+  return true;
+}
+
+void ConfidenceTarget::Record(size_t plan, long long response_us) {
+  auto& state = *plans_[plan];
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.samples++;
+  const double delta = response_us - state.mean;
+  state.mean += delta / state.samples;
+  state.m2 += delta * (response_us - state.mean);
+  state.distribution->Record(response_us);
+
+  if (state.samples < std::max<size_t>(options_.min_iterations, 2)) {
+    return;
+  }
+  if (options_.statistic == TargetStatistic::kP99) {
+    if (state.samples < state.next_check) {
+      return;
+    }
+    state.next_check =
+        state.samples + std::max<size_t>(1, state.samples / kCheckEvery);
+  }
+  if (EstimateLocked(state).converged) {
+    state.done = true;
+  }
+}
+
+ConfidenceEstimate ConfidenceTarget::Estimate(size_t plan) const {
+  const auto& state = *plans_[plan];
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return EstimateLocked(state);
+}
+
+ConfidenceEstimate ConfidenceTarget::EstimateLocked(
+    const PlanState& state) const {
+  ConfidenceEstimate estimate;
+  estimate.launched = state.launched;
+  estimate.samples = state.samples;
+  if (state.samples < 2) {
+    estimate.value_us = estimate.low_us = estimate.high_us = state.mean;
+    return estimate;
+  }
+  const double n = state.samples;
+  bool bounded = true;
+  if (options_.statistic == TargetStatistic::kMean) {
+    const double half_width = kZ * std::sqrt(state.m2 / (n - 1) / n);
+    estimate.value_us = state.mean;
+    estimate.low_us = state.mean - half_width;
+    estimate.high_us = state.mean + half_width;
+  } else {
+    // The number of samples below the true p99 is Binomial(n, 0.99); the
+    // interval runs between the order statistics at its 95% bounds.
+    constexpr double p = 0.99;
+    const double spread = kZ * std::sqrt(n * p * (1 - p));
+    const double low_rank = std::floor(n * p - spread);
+    const double high_rank = std::ceil(n * p + spread);
+    // Too few samples for the upper bound to be one of them.
+    bounded = low_rank >= 1 && high_rank <= n;
+    const auto& distribution = *state.distribution;
+    estimate.value_us = distribution.ValueAtPercentile(p * 100);
+    estimate.low_us =
+        distribution.ValueAtPercentile(std::max(low_rank, 1.0) / n * 100);
+    estimate.high_us =
+        distribution.ValueAtPercentile(std::min(high_rank, n) / n * 100);
+  }
+  estimate.converged =
+      bounded && state.samples >= options_.min_iterations &&
+      (estimate.high_us - estimate.low_us) / 2 <=
+          options_.relative_half_width * estimate.value_us;
+  return estimate;
+}
@@ -0,0 +1,104 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Decides when a command has run often enough for a statistic of its
+// latency to be known to a given precision, so that stable commands stop
+// early and noisy ones get more samples.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "distribution.h"
+
+// The statistic whose confidence interval is watched.
+enum class TargetStatistic {
+  kMean,
+  kP99,
+};
+
+const char* TargetStatisticName(TargetStatistic statistic);
+
+// Parses "mean" or "p99". Returns false for anything else.
+bool ParseTargetStatistic(const std::string& name, TargetStatistic* statistic);
+
+struct ConfidenceOptions {
+  TargetStatistic statistic = TargetStatistic::kMean;
+  // Stop once the half width of the 95% confidence interval is at most this
+  // fraction of the estimate.
+  double relative_half_width = 0.02;
+  // Successful invocations to collect before testing, however narrow the
+  // interval looks.
+  size_t min_iterations = 30;
+  // Launches after which a command stops whether or not it converged.
+  size_t max_iterations = 10000;
+};
+
+// The estimate of a statistic and its 95% confidence interval.
+struct ConfidenceEstimate {
+  size_t launched = 0;
+  // Invocations that exited 0; only they have a latency.
+  size_t samples = 0;
+  double value_us = 0;
+  double low_us = 0;
+  double high_us = 0;
+  bool converged = false;
+};
+
+// Shared by every launcher. The mean is tracked with Welford's running
+// moments and its interval is the normal one; the p99 is read from a
+// distribution and its interval is that of the order statistics, from the
+// binomial distribution of how many samples fall below it.
+class ConfidenceTarget {
+ public:
+  ConfidenceTarget(size_t plans, const ConfidenceOptions& options,
+                   DistributionKind kind, int precision);
+
+  // Called before launching plan. Returns false once the plan has converged
+  // or reached max_iterations; otherwise counts the launch.
+  bool Admit(size_t plan);
+
+  // Adds the response time of an invocation of plan that exited 0.
+  void Record(size_t plan, long long response_us);
+
+  ConfidenceEstimate Estimate(size_t plan) const;
+
+  const ConfidenceOptions& options() const { return options_; }
+
+ private:
+  struct PlanState {
+    mutable std::mutex mutex;
+    std::atomic<bool> done{false};
+    size_t launched = 0;
+    size_t samples = 0;
+    double mean = 0;
+    // Sum of squared differences from the mean.
+    double m2 = 0;
+    std::unique_ptr<Distribution> distribution;
+    // The p99 interval takes a few percentile lookups, so it is only
+    // recomputed as the sample count grows by a fraction.
+    size_t next_check = 0;
+  };
+
+  // With the plan's mutex held.
+  ConfidenceEstimate EstimateLocked(const PlanState& state) const;
+
+  const ConfidenceOptions options_;
+  std::vector<std::unique_ptr<PlanState>> plans_;
+};
@@ -0,0 +1,191 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "confidence.h"
+
+#include <cmath>
+#include <cstddef>
+#include <functional>
+
+#include "test_util.h"
+
+namespace {
+
+// Two sided 95% quantile of the standard normal distribution.
+constexpr double kZ = 1.959963984540054;
+
+// Launches plan 0 until Admit() refuses, recording latency(i) for the i-th
+// launch, and returns how many were launched.
+size_t Run(ConfidenceTarget* target,
+           const std::function<long long(size_t)>& latency) {
+  size_t launched = 0;
+  while (target->Admit(0)) {
+    target->Record(0, latency(launched));
+    launched++;
+  }
+  return launched;
+}
+
+// A command that always takes as long has a zero width interval, so it stops
+// as soon as it has min_iterations samples.
+void TestConstantStopsAtMin() {
+  for (auto statistic : {TargetStatistic::kMean, TargetStatistic::kP99}) {
+    ConfidenceOptions options;
+    options.statistic = statistic;
+    options.min_iterations = 30;
+    if (statistic == TargetStatistic::kP99) {
+      // The p99 interval needs enough samples for its upper order statistic
+      // to exist: 30 are too few.
+      options.min_iterations = 1000;
+    }
+    ConfidenceTarget target(1, options, DistributionKind::kHistogram, 3);
+    CHECK(Run(&target, [](size_t) { return 1000; }) ==
+          options.min_iterations);
+    const auto estimate = target.Estimate(0);
+    CHECK(estimate.converged);
+    CHECK(estimate.launched == options.min_iterations);
+    CHECK(estimate.samples == options.min_iterations);
+    CHECK_NEAR(estimate.value_us, 1000, 1);
+    CHECK_NEAR(estimate.low_us, estimate.high_us, 1e-9);
+  }
+}
+
+// A command whose latency swings by a factor of 1000 cannot reach a 2% half
+// width in 200 launches, so it stops at max_iterations unconverged.
+void TestNoisyStopsAtMax() {
+  for (auto statistic : {TargetStatistic::kMean, TargetStatistic::kP99}) {
+    ConfidenceOptions options;
+    options.statistic = statistic;
+    options.max_iterations = 200;
+    ConfidenceTarget target(1, options, DistributionKind::kHistogram, 3);
+    CHECK(Run(&target, [](size_t i) { return i % 2 ? 1000000 : 1000; }) ==
+          200);
+    CHECK(!target.Admit(0));
+    const auto estimate = target.Estimate(0);
+    CHECK(!estimate.converged);
+    CHECK(estimate.launched == 200);
+  }
+}
+
+// Plans are tracked apart: one converging does not stop another.
+void TestPlansAreIndependent() {
+  ConfidenceOptions options;
+  options.max_iterations = 100;
+  ConfidenceTarget target(2, options, DistributionKind::kHistogram, 3);
+  size_t launched[2] = {0, 0};
+  for (bool admitted = true; admitted;) {
+    admitted = false;
+    for (size_t plan = 0; plan < 2; ++plan) {
+      if (target.Admit(plan)) {
+        admitted = true;
+        target.Record(plan, plan == 0 ? 500 : 100 + 10000 * (launched[1] % 2));
+        launched[plan]++;
+      }
+    }
+  }
+  CHECK(launched[0] == 30);
+  CHECK(launched[1] == 100);
+  CHECK(target.Estimate(0).converged);
+  CHECK(!target.Estimate(1).converged);
+}
+
+// Failed invocations are launched but never recorded: they count towards
+// max_iterations but not min_iterations.
+void TestFailuresCountTowardsMax() {
+  ConfidenceOptions options;
+  options.max_iterations = 50;
+  ConfidenceTarget target(1, options, DistributionKind::kHistogram, 3);
+  size_t launched = 0;
+  while (target.Admit(0)) {
+    if (launched % 2) {
+      target.Record(0, 1000);
+    }
+    launched++;
+  }
+  CHECK(launched == 50);
+  const auto estimate = target.Estimate(0);
+  CHECK(estimate.samples == 25);
+  CHECK(!estimate.converged);
+}
+
+// 1..10: mean 5.5, sample standard deviation sqrt(55 / 6).
+void TestMeanInterval() {
+  ConfidenceOptions options;
+  options.relative_half_width = 0.001;
+  ConfidenceTarget target(1, options, DistributionKind::kHistogram, 3);
+  for (long long value = 1; value <= 10; ++value) {
+    target.Record(0, value);
+  }
+  const auto estimate = target.Estimate(0);
+  const double half_width = kZ * std::sqrt(55.0 / 6 / 10);
+  CHECK(estimate.samples == 10);
+  CHECK_NEAR(estimate.value_us, 5.5, 1e-12);
+  CHECK_NEAR(estimate.low_us, 5.5 - half_width, 1e-12);
+  CHECK_NEAR(estimate.high_us, 5.5 + half_width, 1e-12);
+  CHECK(!estimate.converged);
+}
+
+// 1..1000, recorded exactly at 5 digits. Binomial(1000, 0.99) has mean 990
+// and standard deviation sqrt(9.9), so the interval runs from the 983rd to
+// the 997th smallest value.
+void TestP99Interval() {
+  ConfidenceOptions options;
+  options.statistic = TargetStatistic::kP99;
+  options.min_iterations = 2000;
+  ConfidenceTarget target(1, options, DistributionKind::kHistogram, 5);
+  for (long long value = 1; value <= 1000; ++value) {
+    target.Record(0, value);
+  }
+  auto estimate = target.Estimate(0);
+  CHECK(estimate.samples == 1000);
+  CHECK(estimate.value_us == 990);
+  CHECK(estimate.low_us == 983);
+  CHECK(estimate.high_us == 997);
+  // A half width of 7 is 0.7% of 990, but min_iterations is not reached.
+  CHECK(!estimate.converged);
+
+  // With 100 samples the upper bound would be the 101st: not converged
+  // however narrow the interval.
+  options.min_iterations = 2;
+  ConfidenceTarget small(1, options, DistributionKind::kHistogram, 5);
+  for (int i = 0; i < 100; ++i) {
+    small.Record(0, 1000);
+  }
+  estimate = small.Estimate(0);
+  CHECK(estimate.low_us == estimate.high_us);
+  CHECK(!estimate.converged);
+}
+
+void TestParseTargetStatistic() {
+  TargetStatistic statistic = TargetStatistic::kMean;
+  CHECK(ParseTargetStatistic("p99", &statistic));
+  CHECK(statistic == TargetStatistic::kP99);
+  CHECK(ParseTargetStatistic("mean", &statistic));
+  CHECK(statistic == TargetStatistic::kMean);
+  CHECK(!ParseTargetStatistic("p50", &statistic));
+  CHECK(statistic == TargetStatistic::kMean);
+}
+
+}  // namespace
+
+int main() {
+  TestConstantStopsAtMin();
+  TestNoisyStopsAtMax();
+  TestPlansAreIndependent();
+  TestFailuresCountTowardsMax();
+  TestMeanInterval();
+  TestP99Interval();
+  TestParseTargetStatistic();
+  return TestStatus();
+}
@@ -0,0 +1,70 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Summaries of a stream of latencies, queried by percentile, whose memory
+// does not grow with the number of values.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Significant decimal digits a distribution keeps.
+constexpr int kMinPrecision = 1;
+constexpr int kMaxPrecision = 5;
+constexpr int kDefaultPrecision = 3;
+
+// Values recorded in (the previous bucket's high, high].
+struct Bucket {
+  int64_t high = 0;
+  uint64_t count = 0;
+};
+
+class Distribution {
+ public:
+  virtual ~Distribution() = default;
+
+  virtual void Record(int64_t value) = 0;
+
+  // Adds the values of a distribution created by the same
+  // CreateDistribution() call arguments.
+  virtual void Merge(const Distribution& other) = 0;
+
+  // The value that percentile percent of the recorded values are less than
+  // or equal to, to within RelativeError(). 0 if nothing was recorded.
+  virtual int64_t ValueAtPercentile(double percentile) const = 0;
+
+  // The non-empty buckets, lowest first.
+  virtual std::vector<Bucket> Buckets() const = 0;
+
+  // Bound on |reported - exact| / exact for ValueAtPercentile().
+  virtual double RelativeError() const = 0;
+
+  virtual const char* name() const = 0;
+
+  virtual std::unique_ptr<Distribution> Clone() const = 0;
+};
+
+enum class DistributionKind {
+  // HdrHistogram-style buckets over a fixed range; see histogram.h.
+  kHistogram,
+  // DDSketch over any range, for runs with no bound on the number of values;
+  // see sketch.h.
+  kSketch,
+};
+
+// precision is clamped to [kMinPrecision, kMaxPrecision].
+std::unique_ptr<Distribution> CreateDistribution(DistributionKind kind,
+                                                 int precision);
@@ -0,0 +1,212 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "event_log.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Chunks are mapped one at a time, so they must start on a page boundary.
+constexpr size_t kPageSize = 4096;
+constexpr size_t kChunkSize = 1 << 20;
+
+void AppendString(std::string* out, const std::string& value) {
+  const uint32_t length = value.size();
+  out->append(reinterpret_cast<const char*>(&length), sizeof(length));
+  out->append(value);
+}
+
+// Reads a length-prefixed string at *offset and advances past it.
+bool ReadString(const char* data, size_t end, size_t* offset,
+                std::string* value) {
+  uint32_t length;
+  if (*offset + sizeof(length) > end) {
+    return false;
+  }
+  memcpy(&length, data + *offset, sizeof(length));
+  *offset += sizeof(length);
+  if (*offset + length > end) {
+    return false;
+  }
+  value->assign(data + *offset, length);
+  *offset += length;
+  return true;
+}
+
+}  // namespace
+
+std::unique_ptr<EventLog> EventLog::Create(const std::string& path,
+                                           const std::vector<Command>& commands,
+                                           int64_t start_time_ns, int* error) {
+  EventLogHeader header = {};
+  memcpy(header.magic, kEventLogMagic, sizeof(header.magic));
+  header.version = kEventLogVersion;
+  header.record_size = sizeof(EventRecord);
+  header.chunk_size = kChunkSize;
+  header.command_count = commands.size();
+  header.start_time_ns = start_time_ns;
+
+  std::string strings;
+  for (const auto& command : commands) {
+    AppendString(&strings, command.name);
+    AppendString(&strings, command.command);
+  }
+  const size_t used = sizeof(header) + strings.size();
+  header.header_size = (used + kPageSize - 1) / kPageSize * kPageSize;
+
+  std::string bytes(header.header_size, '\0');
+  memcpy(&bytes[0], &header, sizeof(header));
+  memcpy(&bytes[sizeof(header)], strings.data(), strings.size());
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    *error = errno;
+    return nullptr;
+  }
+  if (write(fd, bytes.data(), bytes.size()) !=
+      static_cast<ssize_t>(bytes.size())) {
+    *error = errno != 0 ? errno : EIO;
+    close(fd);
+    return nullptr;
+  }
+  return std::unique_ptr<EventLog>(new EventLog(fd, header.header_size));
+}
+
+EventLog::~EventLog() {
+  // Stores through the mappings do not reliably update mtime, so stamp the
+  // end of the run for readers.
+  futimens(fd_, nullptr);
+  close(fd_);
+}
+
+std::unique_ptr<EventLogWriter> EventLog::NewWriter() {
+  return std::make_unique<EventLogWriter>(*this);
+}
+
+off_t EventLog::AddChunk() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const size_t offset = end_;
+  if (ftruncate(fd_, offset + kChunkSize) != 0) {
+    return -1;
+  }
+  end_ += kChunkSize;
+  return offset;
+}
+
+EventLogWriter::~EventLogWriter() {
+  if (chunk_ != nullptr) {
+    munmap(chunk_, kChunkSize);
+  }
+}
+
+void EventLogWriter::Append(const EventRecord& record) {
+  if (limit_ - next_ < static_cast<ptrdiff_t>(sizeof(EventRecord))) {
+    if (failed_) {
+      return;
+    }
+    if (chunk_ != nullptr) {
+      munmap(chunk_, kChunkSize);
+      chunk_ = nullptr;
+    }
+    const off_t offset = log_.AddChunk();
+    void* chunk = offset < 0 ? MAP_FAILED
+                             : mmap(nullptr, kChunkSize, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED, log_.fd_, offset);
+    if (chunk == MAP_FAILED) {
+      std::cerr << "Cannot extend the event log, dropping further events: "
+                << strerror(errno) << std::endl;
+      failed_ = true;
+      next_ = limit_ = nullptr;
+      return;
+    }
+    chunk_ = next_ = static_cast<char*>(chunk);
+    limit_ = chunk_ + kChunkSize;
+  }
+  memcpy(next_, &record, sizeof(record));
+  memcpy(next_, &kEventRecordMagic, sizeof(kEventRecordMagic));
+  next_ += sizeof(record);
+}
+
+std::unique_ptr<EventLogReader> EventLogReader::Open(const std::string& path,
+                                                    int* error) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    *error = errno;
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    *error = errno;
+    close(fd);
+    return nullptr;
+  }
+  const size_t size = st.st_size;
+  if (size < sizeof(EventLogHeader)) {
+    *error = EINVAL;
+    close(fd);
+    return nullptr;
+  }
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    *error = errno;
+    return nullptr;
+  }
+  // Each thread scans its chunks front to back.
+  madvise(data, size, MADV_SEQUENTIAL);
+
+  std::unique_ptr<EventLogReader> reader(
+      new EventLogReader(static_cast<const char*>(data), size));
+  reader->modified_ns_ =
+      st.st_mtim.tv_sec * int64_t{1000000000} + st.st_mtim.tv_nsec;
+  auto& header = reader->header_;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, kEventLogMagic, sizeof(header.magic)) != 0 ||
+      header.version != kEventLogVersion ||
+      header.record_size != sizeof(EventRecord) || header.chunk_size == 0 ||
+      header.header_size > size) {
+    *error = EINVAL;
+    return nullptr;
+  }
+  size_t offset = sizeof(header);
+  for (uint32_t i = 0; i < header.command_count; ++i) {
+    EventLog::Command command;
+    if (!ReadString(reader->data_, header.header_size, &offset,
+                    &command.name) ||
+        !ReadString(reader->data_, header.header_size, &offset,
+                    &command.command)) {
+      *error = EINVAL;
+      return nullptr;
+    }
+    reader->commands_.push_back(std::move(command));
+  }
+  return reader;
+}
+
+EventLogReader::~EventLogReader() {
+  munmap(const_cast<char*>(data_), size_);
+}
+
+size_t EventLogReader::chunk_count() const {
+  const size_t data = size_ - header_.header_size;
+  return (data + header_.chunk_size - 1) / header_.chunk_size;
+}
@@ -0,0 +1,181 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Append-only binary log of every invocation, written through mmap'd chunks
+// that each launcher thread fills on its own.
+//
+// Layout: an EventLogHeader, the commands, zero padding up to header_size,
+// then chunks of chunk_size bytes. A chunk belongs to one writer and holds
+// whole EventRecords from its start; space a writer did not get to fill is
+// zero, so readers skip records whose magic is not kEventRecordMagic.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+constexpr char kEventLogMagic[8] = {'P', 'A', 'R', 'E', 'V', 'L', 'O', 'G'};
+constexpr uint32_t kEventLogVersion = 1;
+constexpr uint32_t kEventRecordMagic = 0x45564e54;  // "EVNT"
+
+struct EventLogHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  // Offset of the first chunk.
+  uint32_t header_size;
+  uint32_t chunk_size;
+  uint32_t command_count;
+  uint32_t reserved;
+  // Wall clock at the start of the run, in nanoseconds since the epoch.
+  // Record times count from here.
+  int64_t start_time_ns;
+  // Followed by command_count pairs of length-prefixed strings: the name
+  // reported for the command (its label, or the command itself), and the
+  // command. Lengths are uint32_t.
+};
+
+// One invocation. Times are nanoseconds since the start of the run.
+struct EventRecord {
+  uint32_t magic;
+  // Index of the command in the header.
+  uint32_t command;
+  uint32_t launcher;
+  // Slot within the launcher.
+  uint32_t slot;
+  int64_t intended_start_ns;
+  int64_t start_ns;
+  int64_t end_ns;
+  // As returned by waitpid(), or -1 if the command could not be spawned.
+  int32_t status;
+  uint32_t reserved;
+  // rusage of the child.
+  int64_t user_us;
+  int64_t system_us;
+  int64_t max_rss_kb;
+  int64_t minor_faults;
+  int64_t major_faults;
+  int64_t voluntary_switches;
+  int64_t involuntary_switches;
+};
+static_assert(sizeof(EventRecord) == 104, "EventRecord is part of the format");
+
+class EventLogWriter;
+
+class EventLog {
+ public:
+  struct Command {
+    std::string name;
+    std::string command;
+  };
+
+  // Creates or truncates the log at path and writes the header. Returns
+  // nullptr with the reason in *error on failure.
+  static std::unique_ptr<EventLog> Create(const std::string& path,
+                                          const std::vector<Command>& commands,
+                                          int64_t start_time_ns, int* error);
+
+  ~EventLog();
+
+  // A writer for one thread. Writers must be destroyed before the log.
+  std::unique_ptr<EventLogWriter> NewWriter();
+
+ private:
+  friend class EventLogWriter;
+
+  EventLog(int fd, size_t header_size) : fd_(fd), end_(header_size) {}
+
+  // Adds a chunk to the end of the file and returns its offset, or -1.
+  off_t AddChunk();
+
+  const int fd_;
+  std::mutex mutex_;
+  // Where the next chunk goes; the file is always this long.
+  size_t end_;
+};
+
+// Appends records to chunks of its own, so that writers never contend
+// except to grow the file once per chunk.
+class EventLogWriter {
+ public:
+  explicit EventLogWriter(EventLog& log) : log_(log) {}
+  ~EventLogWriter();
+
+  EventLogWriter(const EventLogWriter&) = delete;
+  EventLogWriter& operator=(const EventLogWriter&) = delete;
+
+  // record.magic is filled in.
+  void Append(const EventRecord& record);
+
+ private:
+  EventLog& log_;
+  char* chunk_ = nullptr;
+  char* next_ = nullptr;
+  char* limit_ = nullptr;
+  // Set once a chunk could not be added, after which records are dropped.
+  bool failed_ = false;
+};
+
+// Maps a whole log read-only so that threads can scan chunks of it in
+// parallel.
+class EventLogReader {
+ public:
+  // Returns nullptr with the reason in *error if the file cannot be mapped,
+  // or EINVAL if it is not an event log of this version.
+  static std::unique_ptr<EventLogReader> Open(const std::string& path,
+                                              int* error);
+
+  ~EventLogReader();
+
+  EventLogReader(const EventLogReader&) = delete;
+  EventLogReader& operator=(const EventLogReader&) = delete;
+
+  const EventLogHeader& header() const { return header_; }
+  // When the log was last written, in nanoseconds since the epoch. The log
+  // is stamped when it is closed, so normally when the run ended.
+  int64_t modified_ns() const { return modified_ns_; }
+  const std::vector<EventLog::Command>& commands() const { return commands_; }
+
+  size_t chunk_count() const;
+
+  // Calls visit with every record written to the chunk.
+  template <typename Visit>
+  void ForEachRecord(size_t chunk, Visit&& visit) const {
+    const char* begin = data_ + header_.header_size +
+                        chunk * static_cast<size_t>(header_.chunk_size);
+    const char* end = std::min(begin + header_.chunk_size, data_ + size_);
+    for (const char* p = begin; end - p >= static_cast<ptrdiff_t>(
+                                              sizeof(EventRecord));
+         p += sizeof(EventRecord)) {
+      const auto* record = reinterpret_cast<const EventRecord*>(p);
+      if (record->magic == kEventRecordMagic) {
+        visit(*record);
+      }
+    }
+  }
+
+ private:
+  EventLogReader(const char* data, size_t size) : data_(data), size_(size) {}
+
+  const char* data_;
+  size_t size_;
+  int64_t modified_ns_ = 0;
+  EventLogHeader header_ = {};
+  std::vector<EventLog::Command> commands_;
+};
@@ -0,0 +1,199 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "event_log.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "test_util.h"
+
+namespace {
+
+// A path in /tmp, removed when done.
+class TempPath {
+ public:
+  TempPath() {
+    char path[] = "/tmp/event_log_test.XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd >= 0) {
+      close(fd);
+    }
+    path_ = path;
+  }
+  ~TempPath() { unlink(path_.c_str()); }
+
+  const std::string& path() const { return path_; }
+
+ private:
+  std::string path_;
+};
+
+// magic is left 0 for Append() to fill in.
+EventRecord Record(uint32_t launcher, uint32_t index) {
+  EventRecord record = {};
+  record.command = index % 2;
+  record.launcher = launcher;
+  record.slot = index % 7;
+  record.intended_start_ns = index * 1000;
+  record.start_ns = index * 1000 + 10;
+  record.end_ns = index * 1000 + 500;
+  record.status = index % 3 == 0 ? 256 : 0;
+  record.user_us = index;
+  record.max_rss_kb = 1024 + launcher;
+  return record;
+}
+
+// Every record Append()ed, whichever writer and chunk it went to.
+std::vector<EventRecord> ReadAll(const EventLogReader& reader) {
+  std::vector<EventRecord> records;
+  for (size_t chunk = 0; chunk < reader.chunk_count(); ++chunk) {
+    reader.ForEachRecord(chunk, [&records](const EventRecord& record) {
+      records.push_back(record);
+    });
+  }
+  return records;
+}
+
+void TestRoundTrip() {
+  TempPath temp;
+  const std::vector<EventLog::Command> commands = {
+      {"select", "ysqlsh -c \"SELECT 1\""}, {"sleep 1", "sleep 1"}};
+  // Writer 0 fills one chunk and part of a second, writer 1 a few records:
+  // three chunks, two of them mostly zero.
+  const uint32_t per_chunk = (1 << 20) / sizeof(EventRecord);
+  const uint32_t counts[2] = {per_chunk + 5, 3};
+  {
+    int error = 0;
+    auto log = EventLog::Create(temp.path(), commands, 1234567890, &error);
+    CHECK(log != nullptr);
+    if (!log) {
+      return;
+    }
+    auto first = log->NewWriter();
+    auto second = log->NewWriter();
+    for (uint32_t i = 0; i < counts[0]; ++i) {
+      first->Append(Record(0, i));
+      if (i < counts[1]) {
+        second->Append(Record(1, i));
+      }
+    }
+  }
+
+  int error = 0;
+  auto reader = EventLogReader::Open(temp.path(), &error);
+  CHECK(reader != nullptr);
+  if (!reader) {
+    return;
+  }
+  const auto& header = reader->header();
+  CHECK(header.version == kEventLogVersion);
+  CHECK(header.record_size == sizeof(EventRecord));
+  CHECK(header.chunk_size == 1 << 20);
+  CHECK(header.header_size % 4096 == 0);
+  CHECK(header.start_time_ns == 1234567890);
+  CHECK(header.command_count == 2);
+  CHECK(reader->commands().size() == 2);
+  for (size_t i = 0; i < std::min<size_t>(2, reader->commands().size());
+       ++i) {
+    CHECK(reader->commands()[i].name == commands[i].name);
+    CHECK(reader->commands()[i].command == commands[i].command);
+  }
+  CHECK(reader->chunk_count() == 3);
+
+  const auto records = ReadAll(*reader);
+  CHECK(records.size() == counts[0] + counts[1]);
+  uint32_t next[2] = {0, 0};
+  for (const auto& record : records) {
+    CHECK(record.magic == kEventRecordMagic);
+    if (record.launcher > 1) {
+      CHECK(record.launcher <= 1);
+      continue;
+    }
+    // Each writer's records come back in the order it appended them.
+    const auto expected = Record(record.launcher, next[record.launcher]++);
+    CHECK(record.command == expected.command);
+    CHECK(record.slot == expected.slot);
+    CHECK(record.intended_start_ns == expected.intended_start_ns);
+    CHECK(record.start_ns == expected.start_ns);
+    CHECK(record.end_ns == expected.end_ns);
+    CHECK(record.status == expected.status);
+    CHECK(record.user_us == expected.user_us);
+    CHECK(record.max_rss_kb == expected.max_rss_kb);
+  }
+  CHECK(next[0] == counts[0]);
+  CHECK(next[1] == counts[1]);
+}
+
+// Writes a valid log with one command, then overwrites size bytes at offset
+// with value and returns the error Open() reports, or 0.
+int OpenCorrupted(size_t offset, const void* value, size_t size) {
+  TempPath temp;
+  {
+    int error = 0;
+    auto log = EventLog::Create(temp.path(), {{"true", "true"}}, 0, &error);
+    if (!log) {
+      return -1;
+    }
+    log->NewWriter()->Append(Record(0, 0));
+  }
+  const int fd = open(temp.path().c_str(), O_WRONLY);
+  if (fd < 0 || pwrite(fd, value, size, offset) != static_cast<ssize_t>(size)) {
+    return -1;
+  }
+  close(fd);
+  int error = 0;
+  return EventLogReader::Open(temp.path(), &error) ? 0 : error;
+}
+
+void TestRejectsOtherFormats() {
+  const uint32_t zero = 0;
+  CHECK(OpenCorrupted(0, &zero, 0) == 0);
+  CHECK(OpenCorrupted(offsetof(EventLogHeader, magic), "NOTALOG!", 8) ==
+        EINVAL);
+  const uint32_t version = kEventLogVersion + 1;
+  CHECK(OpenCorrupted(offsetof(EventLogHeader, version), &version,
+                      sizeof(version)) == EINVAL);
+  const uint32_t record_size = sizeof(EventRecord) + 8;
+  CHECK(OpenCorrupted(offsetof(EventLogHeader, record_size), &record_size,
+                      sizeof(record_size)) == EINVAL);
+  CHECK(OpenCorrupted(offsetof(EventLogHeader, chunk_size), &zero,
+                      sizeof(zero)) == EINVAL);
+  // More commands than the header has room for.
+  const uint32_t command_count = 1000;
+  CHECK(OpenCorrupted(offsetof(EventLogHeader, command_count),
+                      &command_count, sizeof(command_count)) == EINVAL);
+
+  TempPath empty;
+  int error = 0;
+  CHECK(EventLogReader::Open(empty.path(), &error) == nullptr);
+  CHECK(error == EINVAL);
+  CHECK(EventLogReader::Open("/nonexistent/log", &error) == nullptr);
+  CHECK(error == ENOENT);
+}
+
+}  // namespace
+
+int main() {
+  TestRoundTrip();
+  TestRejectsOtherFormats();
+  return TestStatus();
+}
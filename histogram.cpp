@@ -0,0 +1,157 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+Histogram::Histogram(int precision, int64_t highest)
+    : precision_(std::clamp(precision, kMinPrecision, kMaxPrecision)),
+      highest_(std::max<int64_t>(highest, 2)) {
+  // Enough sub-buckets to tell apart any two values that differ in the last
+  // significant digit, e.g. 2000 for 3 digits.
+  int64_t largest_single_unit = 2;
+  for (int i = 0; i < precision_; ++i) {
+    largest_single_unit *= 10;
+  }
+  sub_bucket_bits_ = 0;
+  while ((int64_t{1} << sub_bucket_bits_) < largest_single_unit) {
+    sub_bucket_bits_++;
+  }
+  sub_bucket_mask_ = (int64_t{1} << sub_bucket_bits_) - 1;
+
+  int buckets = 1;
+  for (int64_t untrackable = int64_t{1} << sub_bucket_bits_;
+       untrackable <= highest_ && untrackable < INT64_MAX / 2;
+       untrackable <<= 1) {
+    buckets++;
+  }
+  const size_t size = static_cast<size_t>(buckets + 1)
+                     << (sub_bucket_bits_ - 1);
+  counts_.resize((size + kChunkSize - 1) / kChunkSize);
+}
+
+Histogram::Histogram(const Histogram& other)
+    : precision_(other.precision_),
+      highest_(other.highest_),
+      sub_bucket_bits_(other.sub_bucket_bits_),
+      sub_bucket_mask_(other.sub_bucket_mask_),
+      total_(other.total_),
+      counts_(other.counts_.size()) {
+  for (size_t chunk = 0; chunk < counts_.size(); ++chunk) {
+    if (other.counts_[chunk]) {
+      counts_[chunk].reset(new uint64_t[kChunkSize]);
+      std::copy_n(other.counts_[chunk].get(), kChunkSize,
+                  counts_[chunk].get());
+    }
+  }
+}
+
+size_t Histogram::IndexOf(int64_t value) const {
+  const int bucket =
+      63 - __builtin_clzll(static_cast<uint64_t>(value | sub_bucket_mask_)) -
+      (sub_bucket_bits_ - 1);
+  const int64_t sub_bucket = value >> bucket;
+  return (static_cast<size_t>(bucket) << (sub_bucket_bits_ - 1)) + sub_bucket;
+}
+
+int64_t Histogram::HighestAt(size_t index) const {
+  const int half_bits = sub_bucket_bits_ - 1;
+  int bucket = static_cast<int>(index >> half_bits) - 1;
+  int64_t sub_bucket = (index & ((size_t{1} << half_bits) - 1)) +
+                       (int64_t{1} << half_bits);
+  if (bucket < 0) {
+    sub_bucket -= int64_t{1} << half_bits;
+    bucket = 0;
+  }
+  return ((sub_bucket + 1) << bucket) - 1;
+}
+
+uint64_t& Histogram::CountAt(size_t index) {
+  auto& chunk = counts_[index >> kChunkBits];
+  if (!chunk) {
+    chunk.reset(new uint64_t[kChunkSize]());
+  }
+  return chunk[index & (kChunkSize - 1)];
+}
+
+void Histogram::Record(int64_t value) {
+  CountAt(IndexOf(std::clamp<int64_t>(value, 0, highest_)))++;
+  total_++;
+}
+
+void Histogram::Merge(const Distribution& distribution) {
+  const auto& other = static_cast<const Histogram&>(distribution);
+  const size_t chunks = std::min(counts_.size(), other.counts_.size());
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    if (!other.counts_[chunk]) {
+      continue;
+    }
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      if (other.counts_[chunk][i] > 0) {
+        CountAt((chunk << kChunkBits) + i) += other.counts_[chunk][i];
+      }
+    }
+  }
+  total_ += other.total_;
+}
+
+int64_t Histogram::ValueAtPercentile(double percentile) const {
+  if (total_ == 0) {
+    return 0;
+  }
+  percentile = std::clamp(percentile, 0.0, 100.0);
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(percentile / 100 * total_)));
+  uint64_t seen = 0;
+  for (size_t chunk = 0; chunk < counts_.size(); ++chunk) {
+    if (!counts_[chunk]) {
+      continue;
+    }
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      seen += counts_[chunk][i];
+      if (seen >= rank) {
+        return std::min(HighestAt((chunk << kChunkBits) + i), highest_);
+      }
+    }
+  }
+  return highest_;
+}
+
+std::vector<Bucket> Histogram::Buckets() const {
+  std::vector<Bucket> buckets;
+  for (size_t chunk = 0; chunk < counts_.size(); ++chunk) {
+    if (!counts_[chunk]) {
+      continue;
+    }
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      if (counts_[chunk][i] > 0) {
+        buckets.push_back({std::min(HighestAt((chunk << kChunkBits) + i),
+                                    highest_),
+                           counts_[chunk][i]});
+      }
+    }
+  }
+  return buckets;
+}
+
+double Histogram::RelativeError() const {
+  // A bucket spans 1/2^(sub_bucket_bits_ - 1) of its smallest value.
+  return 1.0 / (int64_t{1} << (sub_bucket_bits_ - 1));
+}
+
+std::unique_ptr<Distribution> Histogram::Clone() const {
+  return std::make_unique<Histogram>(*this);
+}
@@ -0,0 +1,77 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Latency histogram with logarithmic buckets, in the style of HdrHistogram.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "distribution.h"
+
+// Counts values from 0 up to a fixed highest value in buckets that grow with
+// the value, so that every value is kept to the same number of significant
+// decimal digits. Recording is a few shifts and one increment. Counts are
+// allocated a page at a time as values land in them, so memory follows the
+// range of the values actually recorded, and never grows with their number.
+class Histogram : public Distribution {
+ public:
+  // One day in microseconds.
+  static constexpr int64_t kDefaultHighest = 24LL * 3600 * 1000 * 1000;
+
+  // precision is the number of significant decimal digits kept, between
+  // kMinPrecision and kMaxPrecision. Values above highest are counted as
+  // highest.
+  explicit Histogram(int precision = kDefaultPrecision,
+                     int64_t highest = kDefaultHighest);
+  Histogram(const Histogram& other);
+  Histogram& operator=(const Histogram&) = delete;
+
+  void Record(int64_t value) override;
+  // other must be a Histogram with the same precision and highest value.
+  void Merge(const Distribution& other) override;
+  int64_t ValueAtPercentile(double percentile) const override;
+  std::vector<Bucket> Buckets() const override;
+  double RelativeError() const override;
+  const char* name() const override { return "histogram"; }
+  std::unique_ptr<Distribution> Clone() const override;
+
+ private:
+  // Index into counts_ of the bucket holding value.
+  size_t IndexOf(int64_t value) const;
+  // The largest value that falls in the same bucket as counts_[index].
+  int64_t HighestAt(size_t index) const;
+  // The count at index, allocating its chunk.
+  uint64_t& CountAt(size_t index);
+
+  // Counts per chunk: 4 KiB.
+  static constexpr int kChunkBits = 9;
+  static constexpr size_t kChunkSize = size_t{1} << kChunkBits;
+
+  int precision_;
+  int64_t highest_;
+  // Buckets hold 2^sub_bucket_bits_ values each; bucket b covers values up to
+  // 2^(sub_bucket_bits_ + b), at a resolution of 2^b. Only the upper half of
+  // each bucket past the first is stored, the lower half being the previous
+  // bucket.
+  int sub_bucket_bits_;
+  int64_t sub_bucket_mask_;
+  uint64_t total_ = 0;
+  // The counts of every index, kChunkSize to a chunk; chunks nothing was
+  // recorded in are left unallocated.
+  std::vector<std::unique_ptr<uint64_t[]>> counts_;
+};
@@ -0,0 +1,113 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "histogram.h"
+
+#include <cmath>
+#include <vector>
+
+#include "test_util.h"
+
+namespace {
+
+// Every percentile is within the relative error of the exact one, at every
+// precision.
+void TestPercentileAccuracy() {
+  for (int precision = kMinPrecision; precision <= kMaxPrecision;
+       ++precision) {
+    Histogram histogram(precision);
+    const int64_t count = 200000;
+    for (int64_t value = 1; value <= count; ++value) {
+      histogram.Record(value);
+    }
+    const double error = histogram.RelativeError();
+    CHECK(error <= 2 * std::pow(10.0, -precision));
+    for (double percentile : {1.0, 50.0, 90.0, 99.0, 99.9, 99.99, 100.0}) {
+      const auto exact =
+          static_cast<int64_t>(std::ceil(percentile / 100 * count));
+      CHECK_NEAR(histogram.ValueAtPercentile(percentile), exact,
+                 exact * error);
+    }
+  }
+}
+
+// Small values are exact.
+void TestSmallValuesExact() {
+  Histogram histogram(3);
+  for (int64_t value = 0; value < 2000; ++value) {
+    histogram.Record(value);
+  }
+  CHECK(histogram.ValueAtPercentile(50) == 999);
+  CHECK(histogram.Buckets().size() == 2000);
+}
+
+// Merging two halves gives what recording everything in one would.
+void TestMerge() {
+  Histogram all(3);
+  Histogram odd(3);
+  Histogram even(3);
+  for (int64_t value = 1; value <= 100000; value += 7) {
+    all.Record(value);
+    (value % 2 ? odd : even).Record(value);
+  }
+  odd.Merge(even);
+  const auto expected = all.Buckets();
+  const auto merged = odd.Buckets();
+  CHECK(merged.size() == expected.size());
+  for (size_t i = 0; i < std::min(merged.size(), expected.size()); ++i) {
+    CHECK(merged[i].high == expected[i].high);
+    CHECK(merged[i].count == expected[i].count);
+  }
+  for (double percentile : {50.0, 99.0}) {
+    CHECK(odd.ValueAtPercentile(percentile) ==
+          all.ValueAtPercentile(percentile));
+  }
+}
+
+// Values above the highest trackable value are counted as it.
+void TestBeyondHighest() {
+  Histogram histogram(3, 10000);
+  histogram.Record(5);
+  histogram.Record(10000000);
+  histogram.Record(-3);
+  CHECK(histogram.ValueAtPercentile(100) == 10000);
+  CHECK(histogram.ValueAtPercentile(0) == 0);
+  const auto buckets = histogram.Buckets();
+  CHECK(buckets.size() == 3);
+  CHECK(!buckets.empty() && buckets.back().high == 10000);
+}
+
+void TestEmptyAndClone() {
+  Histogram histogram(3);
+  CHECK(histogram.ValueAtPercentile(50) == 0);
+  CHECK(histogram.Buckets().empty());
+
+  histogram.Record(1234567);
+  const auto clone = histogram.Clone();
+  histogram.Record(1);
+  CHECK(clone->Buckets().size() == 1);
+  CHECK_NEAR(clone->ValueAtPercentile(50), 1234567,
+             1234567 * clone->RelativeError());
+}
+
+}  // namespace
+
+int main() {
+  TestPercentileAccuracy();
+  TestSmallValuesExact();
+  TestMerge();
+  TestBeyondHighest();
+  TestEmptyAndClone();
+  return TestStatus();
+}
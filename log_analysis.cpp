@@ -0,0 +1,216 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "log_analysis.h"
+
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+constexpr auto kKind = DistributionKind::kSketch;
+
+// How much later than the log's modification time a record may end, for
+// the wall clock having been adjusted during the run.
+constexpr int64_t kClockSlackNs = 60LL * 1000 * 1000 * 1000;
+
+int64_t ServiceNs(const EventRecord& record) {
+  return record.end_ns - record.start_ns;
+}
+
+bool LongerService(const EventRecord& a, const EventRecord& b) {
+  return ServiceNs(a) > ServiceNs(b);
+}
+
+// What one thread saw in its share of the chunks.
+struct Partial {
+  explicit Partial(size_t commands)
+      : stats(commands, CommandStats(kKind, kDefaultPrecision)) {}
+
+  std::vector<CommandStats> stats;
+  std::vector<IntervalStats> intervals;
+  // A min-heap on service time, at most top long.
+  std::vector<EventRecord> outliers;
+  int64_t last_end_ns = 0;
+  bool open_loop = false;
+  size_t corrupt = 0;
+  bool too_many_intervals = false;
+
+  void Add(const EventRecord& record, int64_t interval_ns, int64_t max_end_ns,
+           size_t top) {
+    if (record.command >= stats.size()) {
+      return;
+    }
+    if (record.start_ns < 0 || record.intended_start_ns < 0 ||
+        record.end_ns < record.start_ns || record.end_ns > max_end_ns) {
+      corrupt++;
+      return;
+    }
+    auto& command = stats[record.command];
+    last_end_ns = std::max(last_end_ns, record.end_ns);
+    open_loop = open_loop || record.intended_start_ns != record.start_ns;
+
+    IntervalStats* interval = nullptr;
+    if (interval_ns > 0) {
+      // Intervals end on their boundary, like those printed during a run.
+      const size_t index =
+          std::max<int64_t>(record.end_ns - 1, 0) / interval_ns;
+      if (index >= kMaxIntervals) {
+        too_many_intervals = true;
+      } else {
+        if (index >= intervals.size()) {
+          intervals.resize(index + 1,
+                           IntervalStats(kKind, kDefaultPrecision));
+        }
+        interval = &intervals[index];
+      }
+    }
+
+    if (record.status < 0) {
+      command.not_spawned++;
+      if (interval != nullptr) {
+        interval->failures++;
+      }
+      return;
+    }
+
+    const long long service_us = ServiceNs(record) / 1000;
+    rusage usage = {};
+    usage.ru_utime = {record.user_us / 1000000, record.user_us % 1000000};
+    usage.ru_stime = {record.system_us / 1000000, record.system_us % 1000000};
+    usage.ru_maxrss = record.max_rss_kb;
+    usage.ru_minflt = record.minor_faults;
+    usage.ru_majflt = record.major_faults;
+    usage.ru_nvcsw = record.voluntary_switches;
+    usage.ru_nivcsw = record.involuntary_switches;
+    command.usage.Record(usage, service_us);
+
+    if (WIFEXITED(record.status) && WEXITSTATUS(record.status) == 0) {
+      const long long response_us =
+          (record.end_ns - record.intended_start_ns) / 1000;
+      command.service.Record(service_us);
+      command.response.Record(response_us);
+      if (interval != nullptr) {
+        interval->latency.Record(response_us);
+      }
+    } else {
+      command.failed.Record(service_us);
+      if (WIFSIGNALED(record.status)) {
+        command.killed++;
+      } else {
+        command.exited_nonzero++;
+      }
+      if (interval != nullptr) {
+        interval->failures++;
+      }
+    }
+
+    if (top == 0) {
+      return;
+    }
+    if (outliers.size() < top) {
+      outliers.push_back(record);
+      std::push_heap(outliers.begin(), outliers.end(), LongerService);
+    } else if (LongerService(record, outliers.front())) {
+      std::pop_heap(outliers.begin(), outliers.end(), LongerService);
+      outliers.back() = record;
+      std::push_heap(outliers.begin(), outliers.end(), LongerService);
+    }
+  }
+};
+
+}  // namespace
+
+LogAnalysis AnalyzeEventLog(const EventLogReader& log,
+                            std::chrono::nanoseconds interval, size_t top,
+                            unsigned threads) {
+  const auto& commands = log.commands();
+  const size_t chunks = log.chunk_count();
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::max<size_t>(1, std::min<size_t>(threads, chunks));
+
+  // No record can end after the log was last written.
+  const int64_t max_end_ns =
+      std::max<int64_t>(log.modified_ns() - log.header().start_time_ns, 0) +
+      kClockSlackNs;
+  std::vector<Partial> partials(threads, Partial(commands.size()));
+  auto scan = [&](size_t thread) {
+    auto& partial = partials[thread];
+    for (size_t chunk = thread; chunk < chunks; chunk += threads) {
+      log.ForEachRecord(chunk, [&](const EventRecord& record) {
+        partial.Add(record, interval.count(), max_end_ns, top);
+      });
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t thread = 1; thread < threads; ++thread) {
+    workers.emplace_back(scan, thread);
+  }
+  scan(0);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  LogAnalysis analysis;
+  std::unordered_map<std::string, size_t> row_index;
+  for (const auto& command : commands) {
+    auto [it, inserted] = row_index.emplace(command.name, analysis.rows.size());
+    if (inserted) {
+      analysis.rows.push_back(
+          {command.name, CommandStats(kKind, kDefaultPrecision)});
+    }
+    analysis.row_of_command.push_back(it->second);
+  }
+
+  int64_t last_end_ns = 0;
+  for (auto& partial : partials) {
+    for (size_t command = 0; command < commands.size(); ++command) {
+      analysis.rows[analysis.row_of_command[command]].stats.Merge(
+          partial.stats[command]);
+    }
+    if (partial.intervals.size() > analysis.intervals.size()) {
+      analysis.intervals.resize(partial.intervals.size(),
+                                IntervalStats(kKind, kDefaultPrecision));
+    }
+    for (size_t i = 0; i < partial.intervals.size(); ++i) {
+      analysis.intervals[i].Merge(partial.intervals[i]);
+    }
+    analysis.outliers.insert(analysis.outliers.end(),
+                             partial.outliers.begin(), partial.outliers.end());
+    last_end_ns = std::max(last_end_ns, partial.last_end_ns);
+    analysis.open_loop = analysis.open_loop || partial.open_loop;
+    analysis.corrupt += partial.corrupt;
+    analysis.too_many_intervals =
+        analysis.too_many_intervals || partial.too_many_intervals;
+  }
+
+  analysis.elapsed = std::chrono::nanoseconds(last_end_ns);
+  for (size_t i = 0; i < analysis.intervals.size(); ++i) {
+    auto& stats = analysis.intervals[i];
+    const auto start = interval * static_cast<int64_t>(i);
+    stats.end = std::min(start + interval, analysis.elapsed);
+    stats.length = stats.end - start;
+  }
+  std::sort(analysis.outliers.begin(), analysis.outliers.end(),
+            LongerService);
+  if (analysis.outliers.size() > top) {
+    analysis.outliers.resize(top);
+  }
+  return analysis;
+}
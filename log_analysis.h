@@ -0,0 +1,59 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Recomputes the summary of a run from its event log, without running
+// anything.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "event_log.h"
+#include "report.h"
+#include "scheduler.h"
+
+// Intervals a report may split a log into, so that a tiny --interval over a
+// long run cannot allocate without bound.
+constexpr size_t kMaxIntervals = 100000;
+
+struct LogAnalysis {
+  // One per name in the log, in the order the names first appear.
+  std::vector<ReportRow> rows;
+  // row_of_command[c] is the row command c of the log is reported in.
+  std::vector<size_t> row_of_command;
+  std::vector<IntervalStats> intervals;
+  // The invocations with the longest service time, longest first.
+  std::vector<EventRecord> outliers;
+  // When the last invocation ended.
+  std::chrono::nanoseconds elapsed{0};
+  // Whether any invocation started later than intended, as in open loop.
+  bool open_loop = false;
+  // Records left out because their times cannot be right: before the start
+  // of the run, ending before they started, or ending after the log was
+  // last written.
+  size_t corrupt = 0;
+  // Set if the run lasted more than kMaxIntervals intervals. The intervals
+  // past that are left out.
+  bool too_many_intervals = false;
+};
+
+// Splits the chunks of the log over threads (0 for one per CPU) and merges
+// what each of them saw. Latencies are summarized by sketches, since a log
+// has no bound on them.
+LogAnalysis AnalyzeEventLog(const EventLogReader& log,
+                            std::chrono::nanoseconds interval, size_t top,
+                            unsigned threads);
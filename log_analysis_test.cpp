@@ -0,0 +1,128 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "log_analysis.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "test_util.h"
+
+namespace {
+
+// A path in /tmp, removed when done.
+class TempPath {
+ public:
+  TempPath() {
+    char path[] = "/tmp/log_analysis_test.XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd >= 0) {
+      close(fd);
+    }
+    path_ = path;
+  }
+  ~TempPath() { unlink(path_.c_str()); }
+
+  const std::string& path() const { return path_; }
+
+ private:
+  std::string path_;
+};
+
+constexpr int64_t kMillisecond = 1000 * 1000;
+
+EventRecord Record(int64_t start_ns, int64_t end_ns) {
+  EventRecord record = {};
+  record.intended_start_ns = start_ns;
+  record.start_ns = start_ns;
+  record.end_ns = end_ns;
+  return record;
+}
+
+// A run that started 10s ago: 100 invocations of 1ms over its first 100ms,
+// and two with times that cannot be right.
+void WriteLog(const std::string& path) {
+  const int64_t start_time_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count() -
+      10000 * kMillisecond;
+  int error = 0;
+  auto log = EventLog::Create(path, {{"true", "true"}}, start_time_ns, &error);
+  CHECK(log != nullptr);
+  if (!log) {
+    return;
+  }
+  auto writer = log->NewWriter();
+  for (int64_t i = 0; i < 100; ++i) {
+    writer->Append(Record(i * kMillisecond, (i + 1) * kMillisecond));
+  }
+  // Ends a day after the log was written, as a corrupt end time would.
+  writer->Append(Record(0, 86400000 * kMillisecond));
+  // Ends before it started.
+  writer->Append(Record(5 * kMillisecond, 4 * kMillisecond));
+}
+
+void TestSkipsImpossibleTimes() {
+  TempPath temp;
+  WriteLog(temp.path());
+  int error = 0;
+  auto log = EventLogReader::Open(temp.path(), &error);
+  CHECK(log != nullptr);
+  if (!log) {
+    return;
+  }
+  const auto analysis =
+      AnalyzeEventLog(*log, std::chrono::milliseconds(10), 10, 2);
+  CHECK(analysis.corrupt == 2);
+  CHECK(!analysis.too_many_intervals);
+  CHECK(analysis.rows.size() == 1);
+  if (analysis.rows.size() == 1) {
+    CHECK(analysis.rows[0].stats.service.count == 100);
+  }
+  CHECK(analysis.intervals.size() == 10);
+  CHECK(analysis.elapsed == std::chrono::milliseconds(100));
+}
+
+void TestBoundsIntervals() {
+  TempPath temp;
+  WriteLog(temp.path());
+  int error = 0;
+  auto log = EventLogReader::Open(temp.path(), &error);
+  CHECK(log != nullptr);
+  if (!log) {
+    return;
+  }
+  // 100ms of 100ns intervals is a million of them.
+  const auto analysis =
+      AnalyzeEventLog(*log, std::chrono::nanoseconds(100), 10, 2);
+  CHECK(analysis.too_many_intervals);
+  CHECK(analysis.intervals.size() <= kMaxIntervals);
+  CHECK(analysis.rows.size() == 1);
+  if (analysis.rows.size() == 1) {
+    CHECK(analysis.rows[0].stats.service.count == 100);
+  }
+}
+
+}  // namespace
+
+int main() {
+  TestSkipsImpossibleTimes();
+  TestBoundsIntervals();
+  return TestStatus();
+}
@@ -0,0 +1,80 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "paired.h"
+
+#include <cmath>
+#include <iterator>
+
+namespace {
+
+// Two sided 95% quantiles of Student's t with 1 to 30 degrees of freedom.
+constexpr double kStudentT[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+// And of the standard normal distribution, which t tends to.
+constexpr double kZ = 1.959963984540054;
+
+}  // namespace
+
+double StudentT95(size_t freedom) {
+  if (freedom <= std::size(kStudentT)) {
+    return kStudentT[freedom - 1];
+  }
+  // The Cornish-Fisher expansion of t around the normal quantile, to the
+  // 1 / freedom^3 term. From 30 degrees of freedom on it is within 1e-5.
+  const double v = freedom;
+  const double z2 = kZ * kZ;
+  return kZ + kZ * (z2 + 1) / (4 * v) +
+         kZ * ((5 * z2 + 16) * z2 + 3) / (96 * v * v) +
+         kZ * (((3 * z2 + 19) * z2 + 17) * z2 - 15) / (384 * v * v * v);
+}
+
+void PairedDifference::Record(long long a_us, long long b_us) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& summary = summary_;
+  summary.pairs++;
+  const double n = summary.pairs;
+  summary.mean_a_us += (a_us - summary.mean_a_us) / n;
+  summary.mean_b_us += (b_us - summary.mean_b_us) / n;
+  const double difference = b_us - a_us;
+  const double delta = difference - summary.mean_difference_us;
+  summary.mean_difference_us += delta / n;
+  m2_ += delta * (difference - summary.mean_difference_us);
+  if (b_us > a_us) {
+    summary.b_slower++;
+  }
+}
+
+void PairedDifference::RecordBroken() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  summary_.broken++;
+}
+
+PairedSummary PairedDifference::Summary() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PairedSummary summary = summary_;
+  summary.low_us = summary.high_us = summary.mean_difference_us;
+  if (summary.pairs >= 2) {
+    const size_t freedom = summary.pairs - 1;
+    const double half_width =
+        StudentT95(freedom) * std::sqrt(m2_ / freedom / summary.pairs);
+    summary.low_us -= half_width;
+    summary.high_us += half_width;
+  }
+  return summary;
+}
@@ -0,0 +1,58 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Response time differences of two commands run as pairs, back to back in
+// the same slot, so that drift over the run hits both alike and cancels out
+// of the difference.
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+
+struct PairedSummary {
+  // Pairs in which both invocations exited 0.
+  size_t pairs = 0;
+  // Pairs in which either failed or was not spawned.
+  size_t broken = 0;
+  double mean_a_us = 0;
+  double mean_b_us = 0;
+  // Of B - A, with its 95% confidence interval.
+  double mean_difference_us = 0;
+  double low_us = 0;
+  double high_us = 0;
+  // Pairs in which B took longer than A.
+  size_t b_slower = 0;
+};
+
+// Two sided 95% quantile of Student's t with freedom >= 1 degrees of
+// freedom, from a table up to 30 and an expansion around the normal
+// quantile beyond.
+double StudentT95(size_t freedom);
+
+// Shared by every launcher.
+class PairedDifference {
+ public:
+  void Record(long long a_us, long long b_us);
+  void RecordBroken();
+
+  // The interval is Student's t for up to 30 pairs and normal beyond.
+  PairedSummary Summary() const;
+
+ private:
+  mutable std::mutex mutex_;
+  PairedSummary summary_;
+  // Welford's sum of squared differences from the mean difference.
+  double m2_ = 0;
+};
@@ -0,0 +1,99 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "paired.h"
+
+#include <cmath>
+
+#include "test_util.h"
+
+namespace {
+
+void TestStudentT() {
+  CHECK_NEAR(StudentT95(1), 12.706, 1e-9);
+  CHECK_NEAR(StudentT95(2), 4.303, 1e-9);
+  CHECK_NEAR(StudentT95(4), 2.776, 1e-9);
+  CHECK_NEAR(StudentT95(10), 2.228, 1e-9);
+  CHECK_NEAR(StudentT95(30), 2.042, 1e-9);
+  // Beyond the table t goes on falling towards the normal quantile, rather
+  // than jumping to it.
+  CHECK_NEAR(StudentT95(31), 2.0395, 1e-4);
+  CHECK_NEAR(StudentT95(40), 2.0211, 1e-4);
+  CHECK_NEAR(StudentT95(60), 2.0003, 1e-4);
+  CHECK_NEAR(StudentT95(120), 1.9799, 1e-4);
+  CHECK_NEAR(StudentT95(1000000), 1.959963984540054, 1e-5);
+  for (size_t freedom = 1; freedom < 1000; ++freedom) {
+    CHECK(StudentT95(freedom + 1) <= StudentT95(freedom));
+  }
+}
+
+// Differences 8, 5, 6, 4, 11: mean 6.8, sample variance 7.7, and t with 4
+// degrees of freedom.
+void TestSmallSample() {
+  PairedDifference paired;
+  const long long a[] = {100, 110, 95, 105, 120};
+  const long long b[] = {108, 115, 101, 109, 131};
+  for (int i = 0; i < 5; ++i) {
+    paired.Record(a[i], b[i]);
+  }
+  paired.RecordBroken();
+  const auto summary = paired.Summary();
+  const double half_width = 2.776 * std::sqrt(7.7 / 5);
+  CHECK(summary.pairs == 5);
+  CHECK(summary.broken == 1);
+  CHECK(summary.b_slower == 5);
+  CHECK_NEAR(summary.mean_a_us, 106, 1e-9);
+  CHECK_NEAR(summary.mean_b_us, 112.8, 1e-9);
+  CHECK_NEAR(summary.mean_difference_us, 6.8, 1e-9);
+  CHECK_NEAR(summary.low_us, 6.8 - half_width, 1e-9);
+  CHECK_NEAR(summary.high_us, 6.8 + half_width, 1e-9);
+}
+
+// 100 differences alternating 0 and 2: mean 1, sample variance 100 / 99, and
+// t with 99 degrees of freedom, 1.98422 rather than the normal 1.95996.
+void TestLargeSample() {
+  PairedDifference paired;
+  for (int i = 0; i < 100; ++i) {
+    paired.Record(1000, 1000 + (i % 2) * 2);
+  }
+  const auto summary = paired.Summary();
+  const double half_width = 1.98422 * std::sqrt(1.0 / 99);
+  CHECK(summary.b_slower == 50);
+  CHECK_NEAR(summary.mean_difference_us, 1, 1e-9);
+  CHECK_NEAR(summary.low_us, 1 - half_width, 1e-5);
+  CHECK_NEAR(summary.high_us, 1 + half_width, 1e-5);
+}
+
+// With fewer than two pairs there is no interval.
+void TestTooFewPairs() {
+  PairedDifference paired;
+  auto summary = paired.Summary();
+  CHECK(summary.pairs == 0);
+  CHECK(summary.low_us == 0 && summary.high_us == 0);
+  paired.Record(10, 7);
+  summary = paired.Summary();
+  CHECK(summary.b_slower == 0);
+  CHECK(summary.mean_difference_us == -3);
+  CHECK(summary.low_us == -3 && summary.high_us == -3);
+}
+
+}  // namespace
+
+int main() {
+  TestStudentT();
+  TestSmallSample();
+  TestLargeSample();
+  TestTooFewPairs();
+  return TestStatus();
+}
@@ -14,131 +14,393 @@ limitations under the License.
 
 // Program that runs the provided commands in parallel
 
+#include <fcntl.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "command.h"
+#include "compare.h"
+#include "event_log.h"
+#include "log_analysis.h"
+#include "perf.h"
+#include "report.h"
+#include "reactor.h"
+#include "scheduler.h"
+#include "spawn.h"
+
 const auto kUsage =
-    R"(./parallel [-n <parallelism count>] '<command1>' '<command2>' ...
+    R"(./parallel [-n <copies per command>] [-j <slots> | --all-at-once] [-r <iterations> | --duration <time>] [--target-ci <percent> [--target-statistic=mean|p99] [--min-iterations <n>] [--max-iterations <n>]] [--rate <n>/s [--arrival=fixed|poisson]] [--ab [--ab-order=alternate|random]] [--spawn=fork|vfork|posix_spawn|clone3] [--cgroup <dir>] [--engine=epoll|io_uring] [--launchers <threads>] [--precision <digits>] [--perf] [--interval <time>] [--output-format=text|json|csv] [--output-file <path>] [--event-log <path>] [--baseline <summary> [--alpha <p>] [--threshold <percent>]] [--label <name>] '<command1>' [--label <name>] '<command2>' ...
     Each command is broken down by spaces and double quoted(") strings are treated as a single argument.
     To escape a double quote, use two double quotes("").
-    To escape a single quote, use ''\''.)";
-
-// Exit statuses for programs like 'env' that exec other programs. Copied from
-// coreutils' system.h
-enum {
-  EXIT_CANCELED = 125,      /* Internal error prior to exec attempt.  */
-  EXIT_CANNOT_INVOKE = 126, /* Program located, but not usable.  */
-  EXIT_ENOENT = 127         /* Could not find program to exec.  */
+    To escape a single quote, use ''\''.
+    -n queues that many jobs per command. -j runs at most that many jobs at once (default: number of CPUs)
+    and starts the next queued job as soon as one finishes. --all-at-once starts every job immediately.
+    -r runs every job that many times back to back in the same slot. Stats are aggregated per command.
+    --duration gives every job its own slot and relaunches it as soon as it exits until the time is up,
+    e.g. 300s, 5m or 1h. Cannot be combined with -j or -r.
+    --rate launches jobs open loop at that rate (per s, m or h) on schedule, however many are still running.
+    Without --duration every iteration of every job is launched once, taking the commands in turn.
+    --arrival spaces the launches evenly (fixed, the default) or with exponential gaps (poisson).
+    Open loop runs report response time, measured from when each job was due to start, next to service
+    time, measured from its actual launch, so that a scheduler falling behind does not hide queueing delay.
+    Cannot be combined with -j.
+    --ab takes exactly two commands, A and B, and runs them as pairs back to back in the same slot, so that
+    drift in clock speed, temperature or caches hits both alike. -r and --duration then count pairs.
+    --ab-order puts A first in every other pair of a slot (alternate, the default) or picks the first at
+    random per pair. Reports the mean paired difference B - A with its 95% confidence interval.
+    Cannot be combined with --rate or --target-ci.
+    --spawn selects how children are launched. The default, posix_spawn, does not copy our address space.
+    --cgroup starts every child in the given cgroup v2 directory. Requires --spawn=clone3.
+    --engine selects how children are reaped. io_uring needs Linux 6.7 and falls back to epoll otherwise.
+    --launchers sets how many threads launch and reap jobs (default: number of CPUs). Each one owns a share
+    of the slots and steals queued jobs from the others when its own queue is empty.
+    --precision sets how many significant digits the latency percentiles keep, from 1 to 5 (default: 3).
+    Runs with --duration use a DDSketch instead of a histogram, which covers any latency to the same relative
+    error. Histogram buckets and sketch bins are allocated a page at a time as latencies land in them, so
+    memory grows with the digits and the spread of the latencies but not with the number of jobs.
+    --label names the command that follows it. Stats are reported per label, or per command when unlabeled,
+    with a row for all of them, named all; commands sharing a label are reported together. Latencies are those of the
+    invocations that exited 0; failed ones are reported apart. Exits with 1 if any invocation failed.
+    Every invocation's CPU time, peak RSS, page faults and context switches are reported per command too.
+    --perf also attaches perf_event_open counters to every child and its descendants: task-clock, context
+    switches, cycles, instructions and cache misses, reported with IPC and miss rate. Counters the kernel does
+    not allow are left out; with perf_event_paranoid >= 2 they count user space only. fork and clone3 children
+    are counted from their exec, posix_spawn and vfork ones from just after it.
+    --interval prints throughput, errors and the p50 and p99 response time of every interval of that length
+    (e.g. 1s) while the run goes on, so that warmup and periodic stalls show up.
+    --target-ci relaunches every job until the 95% confidence interval of its command's mean response time,
+    or p99 with --target-statistic=p99, is within that percentage of it (e.g. 2%), and reports how many
+    invocations that took. Commands stop one by one, each after at least --min-iterations successful runs
+    (default: 30) and at most --max-iterations launches (default: 10000). Cannot be combined with -r or --rate.
+    --output-format json or csv prints the full summary in that format instead of the tables: run metadata
+    (host, kernel, start time, settings), per command percentiles, histogram buckets, rusage and error counts.
+    --output-file writes it to a file instead (json unless given), and keeps the tables on stdout.
+    --event-log appends a fixed size binary record for every invocation to the file: command, slot, intended
+    and actual start, end, exit status and rusage. See event_log.h for the format.
+    --baseline compares the response times of every command, and of all of them, with those of a summary saved
+    with --output-format=json, by a Mann-Whitney U test on their buckets. A command regressed if it got slower
+    with a two sided p-value under --alpha (default: 0.01) and its p50 grew by at least --threshold percent
+    (default: 0). Exits with 1 if any did. Refuses a summary recorded at another precision or distribution.
+
+./parallel report [--interval <time>] [--top <n>] [--threads <n>] <event log>
+    Recomputes the summary of a run from its --event-log without running anything: the per command tables,
+    a line per interval (default: 1s) and the n invocations with the longest service time (default: 10).
+    The log is mapped and scanned by that many threads (default: number of CPUs).
+
+./parallel compare [--alpha <p>] [--threshold <percent>] <baseline summary> <new summary>
+    Compares two summaries saved with --output-format=json as --baseline does, without running anything.
+    Exits with 1 if any command regressed. Summaries whose buckets do not line up, from runs with another
+    --precision or with --duration on one side only, are refused as --baseline refuses them.)";
+
+// Commands reported together: every command given the same --label, or
+// every copy of an unlabeled command.
+struct Group {
+  std::string name;
+  std::vector<size_t> plans;
 };
 
-// Split the command line arguments by separator.
-// If we have a "quoted string", we will treat it as a single argument.
-auto Split(const std::string& argv, char separator) {
-  std::vector<std::string> result;
-  std::string arg;
-  bool in_quote = false;
-  for (const char* p = argv.c_str(); *p; ++p) {
-    if (*p == separator && !in_quote) {
-      if (!arg.empty()) {
-        result.push_back(arg);
-        arg.clear();
-      }
-    } else if (*p == '"') {
-      if (in_quote && *(p + 1) != separator) {
-        if (*(p + 1) == '"') {
-          arg.push_back(*p);
-          p++;
-        } else {
-          result.push_back(arg);
-          arg.clear();
-        }
-      }
-      in_quote = !in_quote;
-    } else {
-      if ((*p != ' ' && *p != '\n') || in_quote) {
-        arg.push_back(*p);
-      }
-    }
+// Longer group names are cut to keep the table readable.
+constexpr size_t kMaxNameWidth = 40;
+
+// Widths of the table columns after the name.
+constexpr int kCountWidth = 10;
+constexpr int kLatencyWidth = 10;
+
+size_t NameWidth(const std::vector<ReportRow>& rows) {
+  size_t width = strlen("Command");
+  for (const auto& row : rows) {
+    width = std::max(width, std::min(row.name.size(), kMaxNameWidth));
   }
+  return width;
+}
+
+void PrintName(const std::string& name, size_t width,
+               std::ostream& out = std::cout) {
+  out << std::left << std::setw(width)
+      << (name.size() > kMaxNameWidth
+              ? name.substr(0, kMaxNameWidth - 3) + "..."
+              : name)
+      << std::right;
+}
 
-  if (!arg.empty()) {
-    result.push_back(arg);
+void PrintLatencyHeader() {
+  std::cout << std::setw(kLatencyWidth) << "Min" << std::setw(kLatencyWidth)
+            << "Avg";
+  for (const auto& percentile : kReportPercentiles) {
+    std::cout << std::setw(kLatencyWidth) << percentile.name;
   }
+  std::cout << std::setw(kLatencyWidth) << "Max" << std::endl;
+}
 
-  return result;
+// In milliseconds, then ends the line.
+void PrintLatency(const Stats& stats) {
+  if (stats.count == 0) {
+    std::cout << std::endl;
+    return;
+  }
+  const auto flags = std::cout.flags();
+  const auto precision = std::cout.precision();
+  std::cout << std::fixed << std::setprecision(3) << std::setw(kLatencyWidth)
+            << stats.min_us / 1000.0 << std::setw(kLatencyWidth)
+            << static_cast<double>(stats.total_us) / stats.count / 1000;
+  for (const auto& percentile : kReportPercentiles) {
+    std::cout << std::setw(kLatencyWidth)
+              << stats.PercentileUs(percentile.percentile) / 1000.0;
+  }
+  std::cout << std::setw(kLatencyWidth) << stats.max_us / 1000.0 << std::endl;
+  std::cout.flags(flags);
+  std::cout.precision(precision);
 }
 
-struct Stats {
-  bool success = false;
-  long long elapsed_us = 0;
-};
+// One line per row: every invocation, the failed ones, throughput and
+// goodput (successful invocations per second), then the latencies of the
+// successful invocations picked by latency.
+void PrintTable(const std::vector<ReportRow>& rows,
+                std::chrono::duration<double> elapsed,
+                const Stats CommandStats::*latency) {
+  const size_t name_width = NameWidth(rows);
+  PrintName("Command", name_width);
+  std::cout << std::setw(kCountWidth) << "Count" << std::setw(kCountWidth)
+            << "Errors" << std::setw(8) << "Error%" << std::setw(12)
+            << "Ops/s" << std::setw(12) << "Goodput";
+  PrintLatencyHeader();
 
-void runCommand(const std::string& command, Stats& stats) {
-  const auto start_time = std::chrono::steady_clock::now();
+  const auto flags = std::cout.flags();
+  const auto precision = std::cout.precision();
+  std::cout << std::fixed;
+  for (const auto& row : rows) {
+    const auto& stats = row.stats;
+    const size_t count = stats.invocations();
+    const size_t failures = stats.failures();
+    PrintName(row.name, name_width);
+    std::cout << std::setw(kCountWidth) << count << std::setw(kCountWidth)
+              << failures << std::setw(8) << std::setprecision(2)
+              << (count == 0 ? 0.0 : 100.0 * failures / count)
+              << std::setw(12) << std::setprecision(1)
+              << count / elapsed.count() << std::setw(12)
+              << stats.service.count / elapsed.count();
+    PrintLatency(stats.*latency);
+  }
+  std::cout.flags(flags);
+  std::cout.precision(precision);
+}
 
-  auto pid = fork();
-  if (pid < 0) {
-    std::cerr << "Cannot fork: " << strerror(errno) << std::endl;
-    exit(EXIT_CANCELED);
+// Only printed when something failed, so that failing fast does not hide in
+// the latencies of the successful invocations.
+void PrintFailureTable(const std::vector<ReportRow>& rows) {
+  const size_t name_width = NameWidth(rows);
+  PrintName("Command", name_width);
+  std::cout << std::setw(kCountWidth) << "Non-zero" << std::setw(kCountWidth)
+            << "Killed" << std::setw(kCountWidth) << "Unspawned";
+  PrintLatencyHeader();
+  for (const auto& row : rows) {
+    const auto& stats = row.stats;
+    PrintName(row.name, name_width);
+    std::cout << std::setw(kCountWidth) << stats.exited_nonzero
+              << std::setw(kCountWidth) << stats.killed
+              << std::setw(kCountWidth) << stats.not_spawned;
+    PrintLatency(stats.failed);
   }
+}
 
-  if (pid == 0) {
-    auto cmd = Split(command, ' ');
-    std::vector<char*> args;
-    for (auto& arg : cmd) {
-      args.push_back(&arg[0]);
+// Averages per invocation, except for max RSS which is the peak. CPU% is CPU
+// time over wall time: near 100% means the command was busy on a CPU, near 0
+// that it was waiting, e.g. on a server.
+void PrintUsageTable(const std::vector<ReportRow>& rows) {
+  const size_t name_width = NameWidth(rows);
+  PrintName("Command", name_width);
+  std::cout << std::setw(kLatencyWidth) << "User ms" << std::setw(kLatencyWidth)
+            << "Sys ms" << std::setw(8) << "CPU%" << std::setw(12)
+            << "MaxRSS MB" << std::setw(kCountWidth) << "MinFlt"
+            << std::setw(kCountWidth) << "MajFlt" << std::setw(kCountWidth)
+            << "VolCsw" << std::setw(kCountWidth) << "InvCsw" << std::endl;
+
+  const auto flags = std::cout.flags();
+  const auto precision = std::cout.precision();
+  std::cout << std::fixed;
+  for (const auto& row : rows) {
+    const auto& usage = row.stats.usage;
+    PrintName(row.name, name_width);
+    if (usage.count == 0) {
+      std::cout << std::endl;
+      continue;
     }
-    args.push_back(nullptr);
-    // Child process.
-    int saved_errno;
+    const double count = usage.count;
+    std::cout << std::setprecision(3) << std::setw(kLatencyWidth)
+              << usage.user_us / count / 1000 << std::setw(kLatencyWidth)
+              << usage.system_us / count / 1000 << std::setw(8)
+              << std::setprecision(1)
+              << (usage.wall_us == 0
+                      ? 0.0
+                      : 100.0 * (usage.user_us + usage.system_us) /
+                            usage.wall_us)
+              << std::setw(12) << usage.max_rss_kb / 1024.0
+              << std::setw(kCountWidth) << usage.minor_faults / count
+              << std::setw(kCountWidth) << usage.major_faults / count
+              << std::setw(kCountWidth) << usage.voluntary_switches / count
+              << std::setw(kCountWidth) << usage.involuntary_switches / count
+              << std::endl;
+  }
+  std::cout.flags(flags);
+  std::cout.precision(precision);
+}
 
-    execvp(args[0], args.data());
-    saved_errno = errno;
+// Averages per invocation of each counter, over the invocations it could be
+// attached to; "-" where it never was. IPC is instructions per cycle.
+void PrintPerfTable(const std::vector<ReportRow>& rows) {
+  const size_t name_width = NameWidth(rows);
+  PrintName("Command", name_width);
+  std::cout << std::setw(kLatencyWidth) << "Task ms" << std::setw(kCountWidth)
+            << "CtxSw" << std::setw(12) << "Mcycles" << std::setw(12)
+            << "Minstr" << std::setw(8) << "IPC" << std::setw(12)
+            << "CacheMiss" << std::setw(8) << "Miss%" << std::endl;
 
-    std::cerr << "Cannot run '" << command << "': " << strerror(saved_errno)
-              << std::endl;
-    _exit(saved_errno == ENOENT ? EXIT_ENOENT : EXIT_CANNOT_INVOKE);
+  const auto flags = std::cout.flags();
+  const auto precision = std::cout.precision();
+  std::cout << std::fixed;
+  for (const auto& row : rows) {
+    const auto& perf = row.stats.perf;
+    const auto average = [&perf](int event, double scale, int width,
+                                 int digits) {
+      std::cout << std::setw(width);
+      if (perf.counts[event] == 0) {
+        std::cout << "-";
+      } else {
+        std::cout << std::setprecision(digits)
+                  << perf.sums[event] / scale / perf.counts[event];
+      }
+    };
+    // Of two counters, both of which must have been read.
+    const auto ratio = [&perf](int numerator, int denominator, double scale,
+                               int width) {
+      std::cout << std::setw(width);
+      if (perf.counts[numerator] == 0 || perf.sums[denominator] == 0) {
+        std::cout << "-";
+      } else {
+        std::cout << std::setprecision(2)
+                  << scale * perf.sums[numerator] / perf.sums[denominator];
+      }
+    };
+    PrintName(row.name, name_width);
+    average(kTaskClock, 1e6, kLatencyWidth, 3);
+    average(kContextSwitches, 1, kCountWidth, 1);
+    average(kCycles, 1e6, 12, 3);
+    average(kInstructions, 1e6, 12, 3);
+    ratio(kInstructions, kCycles, 1, 8);
+    average(kCacheMisses, 1, 12, 0);
+    ratio(kCacheMisses, kCacheReferences, 100, 8);
+    std::cout << std::endl;
+  }
+  std::cout.flags(flags);
+  std::cout.precision(precision);
+}
+
+// A row per group, in the order the commands were given.
+std::vector<ReportRow> BuildRows(const std::vector<Group>& groups,
+                                 const std::vector<CommandStats>& stats) {
+  std::vector<ReportRow> rows;
+  for (const auto& group : groups) {
+    ReportRow row{group.name, stats[group.plans.front()]};
+    for (size_t i = 1; i < group.plans.size(); ++i) {
+      row.stats.Merge(stats[group.plans[i]]);
+    }
+    rows.push_back(std::move(row));
   }
+  return rows;
+}
 
-  // Parent process.
-  int status;
-  if (waitpid(pid, &status, 0) == -1) {
-    std::cerr << "Failed waiting for '" << command << "': " << strerror(errno)
+ReportRow MergeRows(const std::vector<ReportRow>& rows) {
+  ReportRow all{kAllRowName, rows.front().stats};
+  for (size_t i = 1; i < rows.size(); ++i) {
+    all.stats.Merge(rows[i].stats);
+  }
+  return all;
+}
+
+// A row per group, and one for all of them when there are several. In open
+// loop the response time, measured from each job's intended start, is the
+// latency clients see; service time is reported next to it.
+void PrintStats(std::vector<ReportRow> rows, const ReportRow& all,
+                std::chrono::duration<double> elapsed, bool open_loop,
+                const PerfSupport& perf) {
+  if (rows.size() > 1) {
+    rows.push_back(all);
+  }
+
+  if (open_loop) {
+    std::cout << "Response time (from intended start), ms:" << std::endl;
+    PrintTable(rows, elapsed, &CommandStats::response);
+    std::cout << "Service time (from launch), ms:" << std::endl;
+    PrintTable(rows, elapsed, &CommandStats::service);
+  } else {
+    std::cout << "Latency, ms:" << std::endl;
+    PrintTable(rows, elapsed, &CommandStats::service);
+  }
+  if (all.stats.failures() > 0) {
+    std::cout << "Failed invocations, service time in ms:" << std::endl;
+    PrintFailureTable(rows);
+  }
+  std::cout << "Resource usage per invocation:" << std::endl;
+  PrintUsageTable(rows);
+  if (perf.any()) {
+    std::cout << "Perf counters per invocation"
+              << (perf.user_only ? " (user space only)" : "") << ":"
               << std::endl;
-    _exit(EXIT_CANCELED);
+    PrintPerfTable(rows);
   }
+  const auto& distribution = *all.stats.service.distribution;
+  std::cout << "Percentiles within " << distribution.RelativeError() * 100
+            << "% (" << distribution.name() << ")" << std::endl;
+}
 
-  stats.success = true;
-  stats.elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
-                         std::chrono::steady_clock::now() - start_time)
-                         .count();
+// One line per --interval, e.g. to spot warmup or periodic stalls.
+void PrintInterval(std::ostream& out, const IntervalStats& interval) {
+  const double seconds =
+      std::chrono::duration<double>(interval.length).count();
+  const auto& latency = interval.latency;
+  const auto flags = out.flags();
+  const auto precision = out.precision();
+  out << std::fixed << std::setprecision(1) << "[" << std::setw(8)
+      << std::chrono::duration<double>(interval.end).count() << "s]"
+      << std::setw(12) << (latency.count + interval.failures) / seconds
+      << " ops/s" << std::setw(8) << interval.failures << " errors"
+      << std::setprecision(3);
+  if (latency.count > 0) {
+    out << "  p50 " << latency.PercentileUs(50) / 1000.0 << "ms"
+        << "  p99 " << latency.PercentileUs(99) / 1000.0 << "ms";
+  }
+  out << std::endl;
+  out.flags(flags);
+  out.precision(precision);
 }
 
-void PrintStats(const std::vector<Stats>& stats) {
-  double min = 0, avg = 0, max = 0;
-  int success_count = 0;
-  for (const auto& stat : stats) {
-    if (stat.success) {
-      if (success_count == 0) {
-        min = max = avg = stat.elapsed_us;
-      } else {
-        min = std::min(min, (double)stat.elapsed_us);
-        max = std::max(max, (double)stat.elapsed_us);
-        avg += stat.elapsed_us;
-      }
-      success_count++;
-    }
+void PrintOverhead(const Overhead& overhead) {
+  if (overhead.launched == 0) {
+    return;
   }
-  avg /= success_count;
-  std::cout << "Min: " << min / 1000 << "ms" << std::endl
-            << "Avg: " << avg / 1000 << "ms" << std::endl
-            << "Max: " << max / 1000 << "ms" << std::endl;
+  const double launched = overhead.launched;
+  std::cout << "Launch overhead: "
+            << std::chrono::duration<double, std::milli>(overhead.launch)
+                       .count() /
+                   launched
+            << "ms/launch" << std::endl
+            << "Reap overhead: "
+            << std::chrono::duration<double, std::milli>(overhead.reap)
+                       .count() /
+                   launched
+            << "ms/launch" << std::endl;
 }
 
 void PrintUsageAndExit() {
@@ -146,58 +408,889 @@ void PrintUsageAndExit() {
   _exit(1);
 }
 
-std::pair<std::vector<std::string>, size_t> ParseArgs(int argc, char* argv[]) {
-  size_t parallelism = 1;
+struct Options {
   std::vector<std::string> commands;
+  // labels[i] names commands[i], or is empty.
+  std::vector<std::string> labels;
+  size_t copies = 1;
+  size_t iterations = 1;
+  // 0 runs every job at once.
+  size_t slots = std::max(1u, std::thread::hardware_concurrency());
+  // 0 when the run is not time based.
+  std::chrono::nanoseconds duration{0};
+  bool slots_given = false;
+  bool iterations_given = false;
+  // Launches per second, 0 to run closed loop.
+  double rate = 0;
+  Arrival arrival = Arrival::kFixed;
+  SpawnBackend spawn_backend = kDefaultSpawnBackend;
+  std::string cgroup;
+  ReactorEngine engine = kDefaultReactorEngine;
+  // 0 uses one per CPU.
+  size_t launchers = 0;
+  int precision = kDefaultPrecision;
+  bool perf = false;
+  // 0 reports only at the end.
+  std::chrono::nanoseconds interval{0};
+  std::string event_log;
+  // Run the two commands as pairs.
+  bool ab = false;
+  PairOrder pair_order = PairOrder::kAlternate;
+  // Whether --target-ci was given.
+  bool target_ci = false;
+  ConfidenceOptions confidence;
+  // Empty to compare with nothing.
+  std::string baseline;
+  ComparisonOptions comparison;
+  OutputFormat output_format = OutputFormat::kText;
+  // Empty for stdout.
+  std::string output_file;
+};
+
+// Matches "--name value" and "--name=value". On a match stores the value and
+// advances i past it.
+bool OptionValue(int argc, char* argv[], int& i, const char* name,
+                 std::string* value) {
+  const auto name_len = strlen(name);
+  if (strncmp(argv[i], name, name_len) != 0) {
+    return false;
+  }
+  if (argv[i][name_len] == '=') {
+    *value = argv[i] + name_len + 1;
+    return true;
+  }
+  if (argv[i][name_len] != '\0') {
+    return false;
+  }
+  if (i + 1 >= argc) {
+    PrintUsageAndExit();
+  }
+  *value = argv[++i];
+  return true;
+}
+
+size_t ParsePositive(const std::string& value) {
+  try {
+    size_t pos;
+    long long number = std::stoll(value, &pos);
+    if (pos == value.size() && number > 0) {
+      return number;
+    }
+  } catch (const std::exception& e) {
+  }
+  PrintUsageAndExit();
+  return 0;
+}
+
+// Parses a duration such as "300s", "5m", "1.5h" or "250ms". A plain number
+// is in seconds.
+std::chrono::nanoseconds ParseDuration(const std::string& value) {
+  try {
+    size_t pos;
+    const double number = std::stod(value, &pos);
+    const auto unit = value.substr(pos);
+    double seconds_per_unit = 0;
+    if (unit.empty() || unit == "s") {
+      seconds_per_unit = 1;
+    } else if (unit == "ms") {
+      seconds_per_unit = 1e-3;
+    } else if (unit == "m") {
+      seconds_per_unit = 60;
+    } else if (unit == "h") {
+      seconds_per_unit = 3600;
+    }
+    if (seconds_per_unit > 0 && number > 0) {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::duration<double>(number * seconds_per_unit));
+    }
+  } catch (const std::exception& e) {
+  }
+  PrintUsageAndExit();
+  return {};
+}
+
+// Parses a rate such as "200/s", "1000/m" or "5/h". A plain number is per
+// second. Returns launches per second.
+double ParseRate(const std::string& value) {
+  try {
+    size_t pos;
+    const double number = std::stod(value, &pos);
+    const auto unit = value.substr(pos);
+    double seconds_per_unit = 0;
+    if (unit.empty() || unit == "/s") {
+      seconds_per_unit = 1;
+    } else if (unit == "/m") {
+      seconds_per_unit = 60;
+    } else if (unit == "/h") {
+      seconds_per_unit = 3600;
+    }
+    if (seconds_per_unit > 0 && number > 0) {
+      return number / seconds_per_unit;
+    }
+  } catch (const std::exception& e) {
+  }
+  PrintUsageAndExit();
+  return 0;
+}
+
+// Parses a percentage such as "5%" or "5".
+double ParsePercent(const std::string& value) {
+  try {
+    size_t pos;
+    const double number = std::stod(value, &pos);
+    const auto unit = value.substr(pos);
+    if ((unit.empty() || unit == "%") && number >= 0) {
+      return number;
+    }
+  } catch (const std::exception& e) {
+  }
+  PrintUsageAndExit();
+  return 0;
+}
+
+// Parses a significance level, such as "0.05".
+double ParseAlpha(const std::string& value) {
+  try {
+    size_t pos;
+    const double number = std::stod(value, &pos);
+    if (pos == value.size() && number > 0 && number < 1) {
+      return number;
+    }
+  } catch (const std::exception& e) {
+  }
+  PrintUsageAndExit();
+  return 0;
+}
+
+// Matches --alpha and --threshold, shared by runs and parallel compare.
+bool ComparisonOption(int argc, char* argv[], int& i,
+                      ComparisonOptions* options) {
+  std::string value;
+  if (OptionValue(argc, argv, i, "--alpha", &value)) {
+    options->alpha = ParseAlpha(value);
+    return true;
+  }
+  if (OptionValue(argc, argv, i, "--threshold", &value)) {
+    options->threshold_percent = ParsePercent(value);
+    return true;
+  }
+  return false;
+}
+
+Options ParseArgs(int argc, char* argv[]) {
+  Options options;
+  std::string value;
+  std::string label;
   for (int i = 1; i < argc; ++i) {
-    if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--n") == 0) {
-      if (i + 1 >= argc) {
+    if (OptionValue(argc, argv, i, "-n", &value) ||
+        OptionValue(argc, argv, i, "--n", &value)) {
+      options.copies = ParsePositive(value);
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "-j", &value) ||
+        OptionValue(argc, argv, i, "--jobs", &value)) {
+      options.slots = ParsePositive(value);
+      options.slots_given = true;
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "-r", &value) ||
+        OptionValue(argc, argv, i, "--repeat", &value)) {
+      options.iterations = ParsePositive(value);
+      options.iterations_given = true;
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--duration", &value)) {
+      options.duration = ParseDuration(value);
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--output-format", &value)) {
+      if (!ParseOutputFormat(value, &options.output_format)) {
+        PrintUsageAndExit();
+      }
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--output-file", &options.output_file)) {
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--event-log", &options.event_log)) {
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--baseline", &options.baseline)) {
+      continue;
+    }
+    if (ComparisonOption(argc, argv, i, &options.comparison)) {
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--interval", &value)) {
+      options.interval = ParseDuration(value);
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--rate", &value)) {
+      options.rate = ParseRate(value);
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--arrival", &value)) {
+      if (!ParseArrival(value, &options.arrival)) {
+        PrintUsageAndExit();
+      }
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--ab-order", &value)) {
+      if (!ParsePairOrder(value, &options.pair_order)) {
+        PrintUsageAndExit();
+      }
+      continue;
+    }
+    if (strcmp(argv[i], "--ab") == 0) {
+      options.ab = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--perf") == 0) {
+      options.perf = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--all-at-once") == 0) {
+      options.slots = 0;
+      options.slots_given = true;
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--spawn", &value)) {
+      if (!ParseSpawnBackend(value, &options.spawn_backend)) {
+        PrintUsageAndExit();
+      }
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--cgroup", &options.cgroup)) {
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--launchers", &value)) {
+      options.launchers = ParsePositive(value);
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--precision", &value)) {
+      const auto digits = ParsePositive(value);
+      if (digits > kMaxPrecision) {
+        PrintUsageAndExit();
+      }
+      options.precision = static_cast<int>(digits);
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--target-ci", &value)) {
+      options.confidence.relative_half_width = ParsePercent(value) / 100;
+      if (options.confidence.relative_half_width <= 0) {
         PrintUsageAndExit();
       }
-      try {
-        parallelism = std::stoi(argv[i + 1]);
-      } catch (const std::exception& e) {
+      options.target_ci = true;
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--target-statistic", &value)) {
+      if (!ParseTargetStatistic(value, &options.confidence.statistic)) {
         PrintUsageAndExit();
       }
-      i++;
       continue;
     }
-    commands.push_back(argv[i]);
+    if (OptionValue(argc, argv, i, "--min-iterations", &value)) {
+      options.confidence.min_iterations = ParsePositive(value);
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--max-iterations", &value)) {
+      options.confidence.max_iterations = ParsePositive(value);
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--engine", &value)) {
+      if (!ParseReactorEngine(value, &options.engine)) {
+        PrintUsageAndExit();
+      }
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--label", &label)) {
+      if (label.empty()) {
+        PrintUsageAndExit();
+      }
+      continue;
+    }
+    options.commands.push_back(argv[i]);
+    options.labels.push_back(label);
+    label.clear();
   }
 
-  if (commands.empty()) {
+  // A --label must be followed by the command it names.
+  if (options.commands.empty() || !label.empty()) {
+    PrintUsageAndExit();
+  }
+  for (size_t i = 0; i < options.commands.size(); ++i) {
+    const auto& name =
+        options.labels[i].empty() ? options.commands[i] : options.labels[i];
+    if (name == kAllRowName) {
+      std::cerr << "'" << kAllRowName
+                << "' names the row of all commands; use another --label"
+                << std::endl;
+      PrintUsageAndExit();
+    }
+  }
+  if (!options.cgroup.empty() &&
+      options.spawn_backend != SpawnBackend::kClone3) {
+    PrintUsageAndExit();
+  }
+  if (options.rate > 0 && options.slots_given) {
+    PrintUsageAndExit();
+  }
+  if (options.ab && (options.commands.size() != 2 || options.rate > 0 ||
+                     options.target_ci)) {
     PrintUsageAndExit();
   }
+  // The number of iterations is up to the confidence target, launched as
+  // fast as the slots allow.
+  if (options.target_ci) {
+    if (options.iterations_given || options.rate > 0 ||
+        options.confidence.min_iterations >
+            options.confidence.max_iterations) {
+      PrintUsageAndExit();
+    }
+    options.iterations = Job::kUnbounded;
+  }
+  // The text summary always goes to stdout.
+  if (!options.output_file.empty() &&
+      options.output_format == OutputFormat::kText) {
+    options.output_format = OutputFormat::kJson;
+  }
+  if (options.duration.count() > 0) {
+    // A job in a time based run never finishes early, so a queued job
+    // would never get a slot.
+    if (options.slots_given || options.iterations_given) {
+      PrintUsageAndExit();
+    }
+    options.slots = 0;
+    options.iterations = Job::kUnbounded;
+  }
+
+  return options;
+}
+
+// The slowest invocations of a logged run, with when and where they ran.
+void PrintOutliers(const LogAnalysis& analysis) {
+  const size_t name_width = NameWidth(analysis.rows);
+  PrintName("Command", name_width);
+  std::cout << std::setw(kLatencyWidth) << "Start s" << std::setw(kCountWidth)
+            << "Launcher" << std::setw(kCountWidth) << "Slot"
+            << std::setw(kLatencyWidth) << "Service" << std::setw(kLatencyWidth)
+            << "Response" << std::setw(kCountWidth) << "Status" << std::endl;
+
+  const auto flags = std::cout.flags();
+  const auto precision = std::cout.precision();
+  std::cout << std::fixed << std::setprecision(3);
+  for (const auto& record : analysis.outliers) {
+    PrintName(analysis.rows[analysis.row_of_command[record.command]].name,
+              name_width);
+    std::cout << std::setw(kLatencyWidth) << record.start_ns / 1e9
+              << std::setw(kCountWidth) << record.launcher
+              << std::setw(kCountWidth) << record.slot
+              << std::setw(kLatencyWidth)
+              << (record.end_ns - record.start_ns) / 1e6
+              << std::setw(kLatencyWidth)
+              << (record.end_ns - record.intended_start_ns) / 1e6
+              << std::setw(kCountWidth);
+    if (record.status < 0) {
+      std::cout << "unspawned";
+    } else if (WIFSIGNALED(record.status)) {
+      std::cout << "signal " + std::to_string(WTERMSIG(record.status));
+    } else {
+      std::cout << WEXITSTATUS(record.status);
+    }
+    std::cout << std::endl;
+  }
+  std::cout.flags(flags);
+  std::cout.precision(precision);
+}
+
+// How many invocations every command took to reach the confidence target.
+// names[p] names plan p.
+void PrintConfidence(std::ostream& out, const std::vector<std::string>& names,
+                     const ConfidenceTarget& target) {
+  size_t name_width = strlen("Command");
+  for (const auto& name : names) {
+    name_width = std::max(name_width, std::min(name.size(), kMaxNameWidth));
+  }
+  const auto& options = target.options();
+  out << "95% confidence interval of the "
+      << TargetStatisticName(options.statistic) << " response time, ms:"
+      << std::endl;
+  PrintName("Command", name_width, out);
+  out << std::setw(kCountWidth) << "Launched" << std::setw(kCountWidth)
+      << "Samples" << std::setw(kLatencyWidth) << "Estimate"
+      << std::setw(kLatencyWidth) << "Low" << std::setw(kLatencyWidth)
+      << "High" << std::setw(kLatencyWidth) << "+/- %"
+      << std::setw(kCountWidth + 1) << "Converged" << std::endl;
+
+  const auto flags = out.flags();
+  const auto precision = out.precision();
+  out << std::fixed;
+  for (size_t plan = 0; plan < names.size(); ++plan) {
+    const auto estimate = target.Estimate(plan);
+    PrintName(names[plan], name_width, out);
+    out << std::setw(kCountWidth) << estimate.launched
+        << std::setw(kCountWidth) << estimate.samples << std::setprecision(3)
+        << std::setw(kLatencyWidth) << estimate.value_us / 1e3
+        << std::setw(kLatencyWidth) << estimate.low_us / 1e3
+        << std::setw(kLatencyWidth) << estimate.high_us / 1e3
+        << std::setprecision(2) << std::setw(kLatencyWidth);
+    if (estimate.value_us > 0) {
+      out << 50 * (estimate.high_us - estimate.low_us) / estimate.value_us;
+    } else {
+      out << "";
+    }
+    out << std::setw(kCountWidth + 1) << (estimate.converged ? "yes" : "no")
+        << std::endl;
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
+
+// The paired differences of an --ab run.
+void PrintPaired(std::ostream& out, const std::string& a, const std::string& b,
+                 const PairedSummary& summary) {
+  out << "A: " << a << std::endl << "B: " << b << std::endl;
+  out << "Paired response time difference B - A, ms:" << std::endl;
+  out << std::setw(kCountWidth) << "Pairs" << std::setw(kCountWidth)
+      << "Broken" << std::setw(kLatencyWidth) << "Mean A"
+      << std::setw(kLatencyWidth) << "Mean B" << std::setw(kLatencyWidth)
+      << "B - A" << std::setw(kLatencyWidth) << "Low"
+      << std::setw(kLatencyWidth) << "High" << std::setw(kLatencyWidth)
+      << "B - A %" << std::setw(kLatencyWidth) << "Low %"
+      << std::setw(kLatencyWidth) << "High %" << std::setw(kCountWidth + 1)
+      << "B slower %" << std::endl;
+
+  const auto flags = out.flags();
+  const auto precision = out.precision();
+  out << std::setw(kCountWidth) << summary.pairs << std::setw(kCountWidth)
+      << summary.broken << std::fixed << std::setprecision(3)
+      << std::setw(kLatencyWidth) << summary.mean_a_us / 1e3
+      << std::setw(kLatencyWidth) << summary.mean_b_us / 1e3 << std::showpos
+      << std::setw(kLatencyWidth) << summary.mean_difference_us / 1e3
+      << std::setw(kLatencyWidth) << summary.low_us / 1e3
+      << std::setw(kLatencyWidth) << summary.high_us / 1e3
+      << std::setprecision(2);
+  // Relative to A's mean, whose own uncertainty is left out.
+  for (double difference_us :
+       {summary.mean_difference_us, summary.low_us, summary.high_us}) {
+    out << std::setw(kLatencyWidth);
+    if (summary.mean_a_us > 0) {
+      out << 100 * difference_us / summary.mean_a_us;
+    } else {
+      out << "";
+    }
+  }
+  out << std::noshowpos << std::setprecision(1) << std::setw(kCountWidth + 1)
+      << (summary.pairs > 0 ? 100.0 * summary.b_slower / summary.pairs : 0)
+      << std::endl;
+  out.flags(flags);
+  out.precision(precision);
+}
+
+// Reads a summary saved with --output-format=json, or exits.
+std::vector<LatencySample> ReadSummaryOrExit(const std::string& path,
+                                             Resolution* resolution) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Cannot read summary '" << path << "': " << strerror(errno)
+              << std::endl;
+    _exit(EXIT_CANCELED);
+  }
+  std::vector<LatencySample> samples;
+  std::string error;
+  if (!ReadJsonSummary(file, &samples, resolution, &error)) {
+    std::cerr << "Cannot read summary '" << path << "': " << error
+              << std::endl;
+    _exit(EXIT_CANCELED);
+  }
+  return samples;
+}
 
-  return {commands, parallelism};
+// Exits unless summaries of these resolutions can be compared.
+void CheckResolutionOrExit(const Resolution& base,
+                           const Resolution& current) {
+  std::string error;
+  if (!SameResolution(base, current, &error)) {
+    std::cerr << "Cannot compare with the baseline: " << error << std::endl;
+    _exit(EXIT_CANCELED);
+  }
+}
+
+// Prints the response times of every command next to the baseline's, and
+// returns whether any regressed.
+bool PrintComparison(std::ostream& out,
+                     const std::vector<LatencySample>& baseline,
+                     const std::vector<LatencySample>& current,
+                     const ComparisonOptions& options) {
+  std::vector<std::string> unmatched;
+  const auto comparisons =
+      CompareSamples(baseline, current, options, &unmatched);
+  for (const auto& name : unmatched) {
+    std::cerr << "Not comparing '" << name
+              << "': it is missing from one of the runs" << std::endl;
+  }
+
+  size_t name_width = strlen("Command");
+  for (const auto& comparison : comparisons) {
+    name_width = std::max(name_width,
+                          std::min(comparison.name.size(), kMaxNameWidth));
+  }
+  out << "Response time vs baseline, ms:" << std::endl;
+  PrintName("Command", name_width, out);
+  out << std::setw(kCountWidth) << "Base n" << std::setw(kCountWidth)
+      << "New n" << std::setw(kLatencyWidth) << "Base p50"
+      << std::setw(kLatencyWidth) << "New p50" << std::setw(kLatencyWidth)
+      << "p50 %" << std::setw(kLatencyWidth) << "Base p99"
+      << std::setw(kLatencyWidth) << "New p99" << std::setw(kLatencyWidth)
+      << "p99 %" << std::setw(kLatencyWidth) << "P(slower)"
+      << std::setw(kLatencyWidth) << "p-value" << std::setw(kCountWidth)
+      << "Verdict" << std::endl;
+
+  const auto flags = out.flags();
+  const auto precision = out.precision();
+  const auto change = [&](int64_t base, int64_t current) {
+    out << std::setw(kLatencyWidth);
+    if (base > 0) {
+      out << std::showpos << 100.0 * (current - base) / base << std::noshowpos;
+    } else {
+      out << "";
+    }
+  };
+  bool regressed = false;
+  for (const auto& comparison : comparisons) {
+    PrintName(comparison.name, name_width, out);
+    out << std::setw(kCountWidth) << comparison.base_count
+        << std::setw(kCountWidth) << comparison.new_count << std::fixed
+        << std::setprecision(3) << std::setw(kLatencyWidth)
+        << comparison.base_p50_us / 1e3 << std::setw(kLatencyWidth)
+        << comparison.new_p50_us / 1e3 << std::setprecision(1);
+    change(comparison.base_p50_us, comparison.new_p50_us);
+    out << std::setprecision(3) << std::setw(kLatencyWidth)
+        << comparison.base_p99_us / 1e3 << std::setw(kLatencyWidth)
+        << comparison.new_p99_us / 1e3 << std::setprecision(1);
+    change(comparison.base_p99_us, comparison.new_p99_us);
+    out << std::setprecision(3) << std::setw(kLatencyWidth)
+        << comparison.slower << std::defaultfloat << std::setprecision(2)
+        << std::setw(kLatencyWidth) << comparison.p_value
+        << std::setw(kCountWidth)
+        << (comparison.regression    ? "regressed"
+            : comparison.improvement ? "improved"
+                                     : "-")
+        << std::endl;
+    regressed = regressed || comparison.regression;
+  }
+  out.flags(flags);
+  out.precision(precision);
+  out << "P(slower) is the chance that a new invocation takes longer than a "
+         "baseline one"
+      << std::endl;
+  return regressed;
+}
+
+// parallel compare [--alpha <p>] [--threshold <percent>] <base> <new>
+int CompareRuns(int argc, char* argv[]) {
+  ComparisonOptions options;
+  std::vector<std::string> paths;
+  for (int i = 2; i < argc; ++i) {
+    if (ComparisonOption(argc, argv, i, &options)) {
+      continue;
+    }
+    paths.push_back(argv[i]);
+  }
+  if (paths.size() != 2) {
+    PrintUsageAndExit();
+  }
+  Resolution base_resolution, current_resolution;
+  const auto baseline = ReadSummaryOrExit(paths[0], &base_resolution);
+  const auto current = ReadSummaryOrExit(paths[1], &current_resolution);
+  CheckResolutionOrExit(base_resolution, current_resolution);
+  return PrintComparison(std::cout, baseline, current, options) ? 1 : 0;
+}
+
+// parallel report [--interval <time>] [--top <n>] [--threads <n>] <log>
+int Report(int argc, char* argv[]) {
+  std::chrono::nanoseconds interval = std::chrono::seconds(1);
+  size_t top = 10;
+  unsigned threads = 0;
+  std::string path;
+  std::string value;
+  for (int i = 2; i < argc; ++i) {
+    if (OptionValue(argc, argv, i, "--interval", &value)) {
+      interval = ParseDuration(value);
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--top", &value)) {
+      top = ParsePositive(value);
+      continue;
+    }
+    if (OptionValue(argc, argv, i, "--threads", &value)) {
+      threads = ParsePositive(value);
+      continue;
+    }
+    if (!path.empty()) {
+      PrintUsageAndExit();
+    }
+    path = argv[i];
+  }
+  if (path.empty()) {
+    PrintUsageAndExit();
+  }
+
+  int error = 0;
+  const auto log = EventLogReader::Open(path, &error);
+  if (!log) {
+    std::cerr << "Cannot read event log '" << path << "': " << strerror(error)
+              << std::endl;
+    return EXIT_CANCELED;
+  }
+  const auto analysis = AnalyzeEventLog(*log, interval, top, threads);
+  if (analysis.rows.empty()) {
+    std::cerr << "No commands in '" << path << "'" << std::endl;
+    return EXIT_CANCELED;
+  }
+  if (analysis.too_many_intervals) {
+    std::cerr << "The run in '" << path << "' spans more than "
+              << kMaxIntervals << " intervals; use a longer --interval"
+              << std::endl;
+    return EXIT_CANCELED;
+  }
+  if (analysis.corrupt > 0) {
+    std::cerr << "Skipped " << analysis.corrupt
+              << " records with impossible times in '" << path << "'"
+              << std::endl;
+  }
+
+  for (const auto& stats : analysis.intervals) {
+    PrintInterval(std::cout, stats);
+  }
+  PrintStats(analysis.rows, MergeRows(analysis.rows), analysis.elapsed,
+             analysis.open_loop, PerfSupport());
+  if (!analysis.outliers.empty()) {
+    std::cout << "Longest service times, ms:" << std::endl;
+    PrintOutliers(analysis);
+  }
+  return 0;
 }
 
 int main(int argc, char* argv[]) {
+  if (argc >= 2 && strcmp(argv[1], "report") == 0) {
+    return Report(argc, argv);
+  }
+  if (argc >= 2 && strcmp(argv[1], "compare") == 0) {
+    return CompareRuns(argc, argv);
+  }
   if (argc < 2) {
     std::cerr << "Usage: " << argv[0] << " <command1> <command2> ... <commandN>"
               << std::endl;
     return 1;
   }
 
-  const auto [commands, parallelism] = ParseArgs(argc, argv);
+  const auto options = ParseArgs(argc, argv);
+  // Read the baseline first, so that a bad one fails before the run.
+  std::vector<LatencySample> baseline;
+  Resolution baseline_resolution;
+  if (!options.baseline.empty()) {
+    baseline = ReadSummaryOrExit(options.baseline, &baseline_resolution);
+  }
 
-  const int count = commands.size() * parallelism;
-  std::vector<std::thread> threads;
-  threads.reserve(count);
-  std::vector<Stats> stats(count);
-  int stat_index = 0;
+  SchedulerOptions scheduler_options;
+  scheduler_options.spawn.backend = options.spawn_backend;
+  scheduler_options.engine = options.engine;
+  scheduler_options.slots = options.slots;
+  scheduler_options.launchers = options.launchers;
+  scheduler_options.rate = options.rate;
+  scheduler_options.arrival = options.arrival;
+  scheduler_options.precision = options.precision;
+  // A machine readable summary on stdout must not be interleaved with
+  // interval lines.
+  const bool summary_on_stdout = options.output_format != OutputFormat::kText &&
+                                 options.output_file.empty();
+  RunInfo info;
+  scheduler_options.interval = options.interval;
+  scheduler_options.on_interval = [&](const IntervalStats& interval) {
+    PrintInterval(summary_on_stdout ? std::cerr : std::cout, interval);
+    info.intervals.push_back(interval);
+  };
+  if (options.perf) {
+    scheduler_options.perf = ProbePerfEvents();
+    std::string missing;
+    for (int event = 0; event < kPerfEventCount; ++event) {
+      if (!scheduler_options.perf.events[event]) {
+        missing += missing.empty() ? "" : ", ";
+        missing += PerfEventName(event);
+      }
+    }
+    if (!missing.empty()) {
+      std::cerr << "Not counting " << missing << ": "
+                << strerror(scheduler_options.perf.error) << std::endl;
+    }
+  }
+  // A time based run has no bound on the number of invocations or on their
+  // latency, so it is summarized by a sketch that covers any range.
+  if (options.duration.count() > 0) {
+    scheduler_options.distribution = DistributionKind::kSketch;
+  }
+  CheckResolutionOrExit(
+      baseline_resolution,
+      ResolutionOf(scheduler_options.distribution, options.precision));
+  if (!options.cgroup.empty()) {
+    scheduler_options.spawn.cgroup_fd =
+        open(options.cgroup.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (scheduler_options.spawn.cgroup_fd < 0) {
+      std::cerr << "Cannot open cgroup '" << options.cgroup
+                << "': " << strerror(errno) << std::endl;
+      return EXIT_CANCELED;
+    }
+  }
 
-  for (const auto command : commands) {
-    for (int j = 0; j < parallelism; ++j) {
-      threads.emplace_back(runCommand, command, std::ref(stats[stat_index++]));
+  // Tokenize every distinct command once, before anything is launched. The
+  // same command under two labels gets a plan per label, so that their
+  // stats stay apart.
+  std::vector<CommandPlan> plans;
+  std::vector<Group> groups;
+  std::vector<size_t> plan_of_command;
+  std::unordered_map<std::string, size_t> plan_index;
+  std::unordered_map<std::string, size_t> group_index;
+  std::vector<EventLog::Command> logged_commands;
+  for (size_t i = 0; i < options.commands.size(); ++i) {
+    const auto& command = options.commands[i];
+    const auto& name = options.labels[i].empty() ? command : options.labels[i];
+    auto [group, new_group] = group_index.emplace(name, groups.size());
+    if (new_group) {
+      groups.push_back(Group{name, {}});
     }
+    auto [it, inserted] =
+        plan_index.emplace(name + '\n' + command, plans.size());
+    if (inserted) {
+      plans.emplace_back(command);
+      if (plans.back().empty()) {
+        PrintUsageAndExit();
+      }
+      groups[group->second].plans.push_back(it->second);
+      logged_commands.push_back({name, command});
+    }
+    plan_of_command.push_back(it->second);
   }
 
-  for (auto& thread : threads) {
-    thread.join();
+  // Resolve the executables up front so that a typo fails the run before any
+  // job starts, instead of once per invocation.
+  PathResolver resolver;
+  int resolve_status = 0;
+  for (auto& plan : plans) {
+    int error = plan.Resolve(resolver);
+    if (error != 0) {
+      std::cerr << "Cannot run '" << plan.command() << "': " << strerror(error)
+                << std::endl;
+      if (resolve_status == 0) {
+        resolve_status = error == ENOENT ? EXIT_ENOENT : EXIT_CANNOT_INVOKE;
+      }
+    }
+  }
+  if (resolve_status != 0) {
+    return resolve_status;
   }
 
-  PrintStats(stats);
+  std::vector<Job> jobs;
+  jobs.reserve(options.commands.size() * options.copies);
+  if (options.ab) {
+    jobs.insert(
+        jobs.end(), options.copies,
+        Job{plan_of_command[0], options.iterations, plan_of_command[1]});
+  } else {
+    for (auto plan : plan_of_command) {
+      jobs.insert(jobs.end(), options.copies, Job{plan, options.iterations});
+    }
+  }
 
-  _exit(0);
-}
\ No newline at end of file
+  std::vector<CommandStats> stats;
+  Overhead overhead;
+  info.command_line.assign(argv, argv + argc);
+  info.start_time = std::chrono::system_clock::now();
+  std::unique_ptr<EventLog> event_log;
+  if (!options.event_log.empty()) {
+    int error = 0;
+    event_log = EventLog::Create(
+        options.event_log, logged_commands,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            info.start_time.time_since_epoch())
+            .count(),
+        &error);
+    if (!event_log) {
+      std::cerr << "Cannot write '" << options.event_log
+                << "': " << strerror(error) << std::endl;
+      return EXIT_CANCELED;
+    }
+    scheduler_options.event_log = event_log.get();
+  }
+  std::unique_ptr<ConfidenceTarget> confidence;
+  if (options.target_ci) {
+    confidence = std::make_unique<ConfidenceTarget>(
+        plans.size(), options.confidence, scheduler_options.distribution,
+        scheduler_options.precision);
+    scheduler_options.confidence = confidence.get();
+  }
+  PairedDifference paired;
+  if (options.ab) {
+    scheduler_options.pair_order = options.pair_order;
+    scheduler_options.paired = &paired;
+  }
+  const auto start_time = std::chrono::steady_clock::now();
+  if (options.duration.count() > 0) {
+    scheduler_options.deadline = start_time + options.duration;
+  }
+  RunJobs(plans, jobs, scheduler_options, stats, overhead);
+  const auto elapsed = std::chrono::steady_clock::now() - start_time;
+
+  const auto rows = BuildRows(groups, stats);
+  const auto all = MergeRows(rows);
+  if (!summary_on_stdout) {
+    PrintStats(rows, all, elapsed, options.rate > 0, scheduler_options.perf);
+    PrintOverhead(overhead);
+  }
+  if (options.output_format != OutputFormat::kText) {
+    info.elapsed = elapsed;
+    info.options = scheduler_options;
+    info.options.on_interval = nullptr;
+    // Record how many launchers actually ran, not the 0 for "one per CPU".
+    info.options.launchers = LauncherCount(scheduler_options, jobs.size());
+    info.overhead = overhead;
+    DescribeHost(&info);
+    std::ofstream file;
+    if (!options.output_file.empty()) {
+      file.open(options.output_file);
+      if (!file) {
+        std::cerr << "Cannot write '" << options.output_file
+                  << "': " << strerror(errno) << std::endl;
+        _exit(EXIT_CANCELED);
+      }
+    }
+    std::ostream& out = options.output_file.empty() ? std::cout : file;
+    if (options.output_format == OutputFormat::kJson) {
+      WriteJson(out, info, rows, all);
+    } else {
+      WriteCsv(out, info, rows, all);
+    }
+  }
+
+  if (confidence) {
+    std::vector<std::string> names;
+    for (const auto& command : logged_commands) {
+      names.push_back(command.name);
+    }
+    PrintConfidence(summary_on_stdout ? std::cerr : std::cout, names,
+                    *confidence);
+  }
+  if (options.ab) {
+    PrintPaired(summary_on_stdout ? std::cerr : std::cout,
+                logged_commands[plan_of_command[0]].name,
+                logged_commands[plan_of_command[1]].name, paired.Summary());
+  }
+  bool regressed = false;
+  if (!options.baseline.empty()) {
+    regressed = PrintComparison(summary_on_stdout ? std::cerr : std::cout,
+                                baseline, LatencySamples(rows, all),
+                                options.comparison);
+  }
+
+  _exit(all.stats.failures() > 0 || regressed ? 1 : 0);
+}
@@ -0,0 +1,155 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "perf.h"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+const struct {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+} kEvents[kPerfEventCount] = {
+    {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+
+// The counter each counter is grouped under, or -1 for a leader. Grouped
+// counters are scheduled onto the PMU together, so that the ratios between
+// them (IPC, miss rate) hold even when the PMU is multiplexed. Leaders come
+// before their members.
+constexpr int kGroupLeader[kPerfEventCount] = {
+    -1, -1, -1, kCycles, -1, kCacheReferences,
+};
+
+// Opens a counter, in the group of group_fd unless it is -1. Members are
+// enabled and disabled with their leader. Every counter is still read on its
+// own: PERF_FORMAT_GROUP reads cannot be combined with inherit on most
+// kernels.
+int Open(int event, pid_t pid, bool user_only, bool enable_on_exec,
+         int group_fd) {
+  const bool leader = group_fd < 0;
+  perf_event_attr attr = {};
+  attr.size = sizeof(attr);
+  attr.type = kEvents[event].type;
+  attr.config = kEvents[event].config;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.inherit = 1;
+  attr.disabled = leader && enable_on_exec;
+  attr.enable_on_exec = leader && enable_on_exec;
+  attr.exclude_kernel = user_only;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, pid, -1, group_fd,
+                 PERF_FLAG_FD_CLOEXEC);
+}
+
+// The fd of event's leader among fds, or -1 if it has none or it is not open.
+int GroupFd(int event, const std::array<int, kPerfEventCount>& fds) {
+  const int leader = kGroupLeader[event];
+  return leader < 0 ? -1 : fds[leader];
+}
+
+}  // namespace
+
+const char* PerfEventName(int event) { return kEvents[event].name; }
+
+bool PerfSupport::any() const {
+  for (bool supported : events) {
+    if (supported) {
+      return true;
+    }
+  }
+  return false;
+}
+
+PerfSupport ProbePerfEvents() {
+  PerfSupport support;
+  for (bool user_only : {false, true}) {
+    support = {};
+    support.user_only = user_only;
+    // Opened the way Attach() opens them, groups included.
+    std::array<int, kPerfEventCount> fds;
+    fds.fill(-1);
+    for (int event = 0; event < kPerfEventCount; ++event) {
+      fds[event] = Open(event, 0, user_only, false, GroupFd(event, fds));
+      if (fds[event] >= 0) {
+        support.events[event] = true;
+      } else if (support.error == 0) {
+        support.error = errno;
+      }
+    }
+    for (int fd : fds) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+    // Only retry user space only if the kernel refused on permissions.
+    if (support.any() || (support.error != EACCES && support.error != EPERM)) {
+      break;
+    }
+  }
+  return support;
+}
+
+void PerfTotals::Merge(const PerfTotals& other) {
+  for (int event = 0; event < kPerfEventCount; ++event) {
+    sums[event] += other.sums[event];
+    counts[event] += other.counts[event];
+  }
+}
+
+void PerfCounters::Attach(const PerfSupport& support, pid_t pid,
+                          bool enable_on_exec) {
+  for (int event = 0; event < kPerfEventCount; ++event) {
+    if (support.events[event]) {
+      fds_[event] = Open(event, pid, support.user_only, enable_on_exec,
+                         GroupFd(event, fds_));
+    }
+  }
+}
+
+void PerfCounters::Collect(PerfTotals* totals) {
+  for (int event = 0; event < kPerfEventCount; ++event) {
+    if (fds_[event] < 0) {
+      continue;
+    }
+    // value, time enabled, time running
+    uint64_t values[3];
+    if (read(fds_[event], values, sizeof(values)) == sizeof(values) &&
+        values[2] > 0) {
+      totals->sums[event] += static_cast<uint64_t>(
+          static_cast<double>(values[0]) * values[1] / values[2]);
+      totals->counts[event]++;
+    }
+  }
+  // Only once all are read, since closing a leader breaks up its group.
+  for (int& fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+}
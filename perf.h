@@ -0,0 +1,80 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Per-child performance counters through perf_event_open(), a lightweight
+// perf stat over every invocation.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+enum PerfEvent {
+  kTaskClock,  // Nanoseconds on a CPU.
+  kContextSwitches,
+  kCycles,
+  kInstructions,
+  kCacheReferences,
+  kCacheMisses,
+  kPerfEventCount,
+};
+
+const char* PerfEventName(int event);
+
+// Which counters can be opened here. Hardware counters are often missing in
+// VMs and containers, and perf_event_paranoid may allow user space counting
+// only.
+struct PerfSupport {
+  std::array<bool, kPerfEventCount> events{};
+  // Counters exclude the kernel, as perf_event_paranoid >= 2 requires.
+  bool user_only = false;
+  // Why the first unsupported counter could not be opened, or 0.
+  int error = 0;
+
+  bool any() const;
+};
+
+// Tries every counter on this process.
+PerfSupport ProbePerfEvents();
+
+// Counters summed over invocations. Each counter has its own count, since a
+// counter may fail to attach to some children, e.g. when out of fds.
+struct PerfTotals {
+  std::array<uint64_t, kPerfEventCount> sums{};
+  std::array<size_t, kPerfEventCount> counts{};
+
+  void Merge(const PerfTotals& other);
+};
+
+// The counters attached to one child.
+class PerfCounters {
+ public:
+  PerfCounters() { fds_.fill(-1); }
+
+  // Opens the supported counters on pid, cycles with instructions and cache
+  // references with cache misses as groups. With inherit set they also count
+  // every process the child starts from then on. With enable_on_exec they
+  // only start at the child's exec, which it must not have done yet.
+  void Attach(const PerfSupport& support, pid_t pid, bool enable_on_exec);
+
+  // Adds the final values, scaled for time spent multiplexed, to totals and
+  // closes the counters. The child must have exited.
+  void Collect(PerfTotals* totals);
+
+ private:
+  std::array<int, kPerfEventCount> fds_;
+};
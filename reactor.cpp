@@ -0,0 +1,558 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "reactor.h"
+
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+namespace {
+
+constexpr int kMaxEvents = 64;
+
+// IORING_OP_WAITID, added in Linux 6.7 and not yet in our uapi headers.
+constexpr uint8_t kIoUringOpWaitid = 50;
+constexpr unsigned kIoUringEntries = 256;
+// Room for every child exiting at once in a large all-at-once run.
+constexpr unsigned kIoUringCqEntries = 16384;
+// Attempts at submitting a full submission queue before giving up.
+constexpr int kMaxSubmitAttempts = 1000;
+
+[[noreturn]] void Fatal(const char* what) {
+  std::cerr << "Failed waiting for children: " << what << ": "
+            << strerror(errno) << std::endl;
+  _exit(EXIT_CANCELED);
+}
+
+int PidfdOpen(pid_t pid) { return syscall(SYS_pidfd_open, pid, 0); }
+
+// libstdc++'s steady_clock is CLOCK_MONOTONIC, which timers take as is.
+timespec ToTimespec(std::chrono::steady_clock::time_point time) {
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      time.time_since_epoch())
+                      .count();
+  return {static_cast<time_t>(ns / 1000000000),
+          static_cast<long>(ns % 1000000000)};
+}
+
+// waitid() with the fifth argument of the system call, which glibc does not
+// expose: the child's rusage, as wait4() reports it.
+int WaitidWithUsage(int idtype, int id, siginfo_t* info, int options,
+                    rusage* usage) {
+  return syscall(SYS_waitid, idtype, id, info, options, usage);
+}
+
+// Converts what waitid() reports back into a waitpid() status.
+int WaitStatus(const siginfo_t& info) {
+  switch (info.si_code) {
+    case CLD_EXITED:
+      return W_EXITCODE(info.si_status, 0);
+    case CLD_DUMPED:
+      return W_EXITCODE(0, info.si_status) | WCOREFLAG;
+    default:
+      return W_EXITCODE(0, info.si_status);
+  }
+}
+
+class EpollReactor : public Reactor {
+ public:
+  EpollReactor() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+      Fatal("epoll_create1");
+    }
+    timer_fd_ =
+        timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd_ < 0) {
+      Fatal("timerfd_create");
+    }
+    Add(timer_fd_);
+
+    if (PidfdsSupported()) {
+      return;
+    }
+
+    // No pidfds. Take SIGCHLD through a signalfd instead; it has to be
+    // blocked in every thread, which inherit our mask from here on. Spawn()
+    // unblocks it again in the children.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+      Fatal("pthread_sigmask");
+    }
+    signal_fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd_ < 0) {
+      Fatal("signalfd");
+    }
+    Add(signal_fd_);
+  }
+
+  ~EpollReactor() override {
+    for (const auto& [pidfd, token] : tokens_) {
+      close(pidfd);
+    }
+    if (signal_fd_ >= 0) {
+      close(signal_fd_);
+    }
+    close(timer_fd_);
+    close(epoll_fd_);
+  }
+
+  void Watch(const SpawnedChild& child, uint64_t token) override {
+    if (signal_fd_ >= 0) {
+      if (child.pidfd >= 0) {
+        close(child.pidfd);
+      }
+      tokens_by_pid_[child.pid] = token;
+      return;
+    }
+
+    int pidfd = child.pidfd >= 0 ? child.pidfd : PidfdOpen(child.pid);
+    if (pidfd < 0) {
+      Fatal("pidfd_open");
+    }
+    Add(pidfd);
+    tokens_[pidfd] = token;
+  }
+
+  size_t Reap(std::chrono::steady_clock::time_point deadline,
+              std::vector<ChildExit>* exits) override {
+    int timeout_ms = -1;
+    if (deadline == kNoWait) {
+      timeout_ms = 0;
+    } else if (deadline != kForever && deadline != timer_deadline_) {
+      // epoll_wait() only takes milliseconds; the timerfd keeps the
+      // deadline to the nanosecond.
+      itimerspec spec = {};
+      spec.it_value = ToTimespec(deadline);
+      if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+        Fatal("timerfd_settime");
+      }
+      timer_deadline_ = deadline;
+    }
+
+    epoll_event events[kMaxEvents];
+    int count;
+    do {
+      count = epoll_wait(epoll_fd_, events, kMaxEvents, timeout_ms);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0) {
+      Fatal("epoll_wait");
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    size_t reaped = 0;
+    for (int i = 0; i < count; ++i) {
+      const int fd = events[i].data.fd;
+      if (fd == signal_fd_) {
+        reaped += ReapSignalled(now, exits);
+        continue;
+      }
+      if (fd == timer_fd_) {
+        uint64_t expirations;
+        if (read(timer_fd_, &expirations, sizeof(expirations)) > 0) {
+          timer_deadline_ = kForever;
+        }
+        continue;
+      }
+
+      siginfo_t info = {};
+      rusage usage = {};
+      if (WaitidWithUsage(P_PIDFD, fd, &info, WEXITED, &usage) != 0) {
+        Fatal("waitid");
+      }
+      auto it = tokens_.find(fd);
+      exits->push_back({it->second, WaitStatus(info), now, usage});
+      tokens_.erase(it);
+      // Children forked since Watch() may still hold a copy of the pidfd
+      // until they exec, which would keep it in the epoll set after close().
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+      close(fd);
+      reaped++;
+    }
+    return reaped;
+  }
+
+ private:
+  void Add(int fd) {
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+      Fatal("epoll_ctl");
+    }
+  }
+
+  size_t ReapSignalled(std::chrono::steady_clock::time_point now,
+                       std::vector<ChildExit>* exits) {
+    // Signals coalesce, so drain the signalfd and then reap every child that
+    // has exited rather than one per signal.
+    signalfd_siginfo info[16];
+    while (read(signal_fd_, info, sizeof(info)) > 0) {
+    }
+
+    size_t reaped = 0;
+    int status;
+    rusage usage;
+    pid_t pid;
+    while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+      auto it = tokens_by_pid_.find(pid);
+      if (it == tokens_by_pid_.end()) {
+        continue;
+      }
+      exits->push_back({it->second, status, now, usage});
+      tokens_by_pid_.erase(it);
+      reaped++;
+    }
+    return reaped;
+  }
+
+  int epoll_fd_ = -1;
+  int signal_fd_ = -1;
+  int timer_fd_ = -1;
+  // What the timerfd is armed for, kForever once it has fired.
+  std::chrono::steady_clock::time_point timer_deadline_ = kForever;
+  // pidfd -> token
+  std::unordered_map<int, uint64_t> tokens_;
+  // pid -> token, in signalfd mode.
+  std::unordered_map<pid_t, uint64_t> tokens_by_pid_;
+};
+
+class IoUringReactor : public Reactor {
+ public:
+  ~IoUringReactor() override {
+    for (auto& [id, waiting] : waiting_) {
+      if (waiting.pidfd >= 0) {
+        close(waiting.pidfd);
+      }
+    }
+    if (sqes_ != nullptr) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    if (ring_fd_ >= 0) {
+      close(ring_fd_);
+    }
+  }
+
+  // Sets up the ring. Returns false if io_uring or IORING_OP_WAITID is not
+  // available, in which case the reactor must not be used.
+  bool Init() {
+    io_uring_params params = {};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = kIoUringCqEntries;
+    ring_fd_ = syscall(SYS_io_uring_setup, kIoUringEntries, &params);
+    if (ring_fd_ < 0 || !(params.features & IORING_FEAT_EXT_ARG) ||
+        !SupportsWaitid()) {
+      return false;
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = Map(sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = (params.features & IORING_FEAT_SINGLE_MMAP)
+                   ? sq_ring_
+                   : Map(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(Map(sqes_size_, IORING_OFF_SQES));
+
+    auto sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+    auto cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  void Watch(const SpawnedChild& child, uint64_t token) override {
+    const uint64_t id = next_id_++;
+    auto& waiting = waiting_[id];
+    waiting.token = token;
+    waiting.pid = child.pid;
+    waiting.pidfd = child.pidfd;
+
+    // Our own children cannot be recycled before we reap them, so a plain
+    // pid is as safe as a pidfd here and saves opening one.
+    io_uring_sqe* sqe = NextSqe();
+    sqe->opcode = kIoUringOpWaitid;
+    if (child.pidfd >= 0) {
+      sqe->len = P_PIDFD;
+      sqe->fd = child.pidfd;
+    } else {
+      sqe->len = P_PID;
+      sqe->fd = child.pid;
+    }
+    // IORING_OP_WAITID has no rusage, so it only notices the exit and the
+    // child is reaped with waitid() once the completion arrives.
+    sqe->file_index = WEXITED | WNOWAIT;
+    sqe->addr2 = reinterpret_cast<uintptr_t>(&waiting.info);
+    sqe->user_data = id;
+    __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+    to_submit_++;
+  }
+
+  size_t Reap(std::chrono::steady_clock::time_point deadline,
+              std::vector<ChildExit>* exits) override {
+    size_t reaped = early_exits_.size();
+    exits->insert(exits->end(), early_exits_.begin(), early_exits_.end());
+    early_exits_.clear();
+    reaped += Complete(exits);
+    const auto now = std::chrono::steady_clock::now();
+    if (reaped > 0 || deadline == kNoWait || deadline <= now) {
+      if (to_submit_ > 0) {
+        Enter(0, nullptr);
+      }
+      return reaped + Complete(exits);
+    }
+
+    if (deadline == kForever) {
+      Enter(1, nullptr);
+    } else {
+      // Relative, but kept by an hrtimer to the nanosecond.
+      const auto ns =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now)
+              .count();
+      __kernel_timespec timeout = {ns / 1000000000, ns % 1000000000};
+      Enter(1, &timeout);
+    }
+    return Complete(exits);
+  }
+
+ private:
+  struct Waiting {
+    uint64_t token = 0;
+    pid_t pid = -1;
+    int pidfd = -1;
+    siginfo_t info = {};
+  };
+
+  bool SupportsWaitid() {
+    const size_t size =
+        sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::vector<char> buffer(size);
+    auto probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+    if (syscall(SYS_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe,
+                256) < 0) {
+      return false;
+    }
+    return probe->last_op >= kIoUringOpWaitid &&
+           (probe->ops[kIoUringOpWaitid].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  void* Map(size_t size, off_t offset) {
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+    if (ptr == MAP_FAILED) {
+      Fatal("mmap io_uring");
+    }
+    return ptr;
+  }
+
+  // A free submission queue entry. When the queue is full it is submitted
+  // first, since reusing an entry the kernel has not consumed would
+  // overwrite a wait and lose that child's exit.
+  io_uring_sqe* NextSqe() {
+    const unsigned tail = *sq_tail_;
+    for (int attempt = 0;
+         tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_;
+         ++attempt) {
+      if (attempt == kMaxSubmitAttempts) {
+        Fatal("io_uring_enter");
+      }
+      if (Enter(0, nullptr)) {
+        continue;
+      }
+      // EBUSY: the completion queue is full, so make room by taking its
+      // entries, to be handed out by the next Reap(). EAGAIN: retry.
+      if (Complete(&early_exits_) == 0) {
+        std::this_thread::yield();
+      }
+    }
+    const unsigned index = tail & sq_mask_;
+    sq_array_[index] = index;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  // Submits the queued waits and, if min_complete is 1, blocks until a
+  // child exits or the timeout passes. Returns false, with errno set, if
+  // interrupted, timed out or the kernel was busy; what was not submitted
+  // stays queued.
+  bool Enter(unsigned min_complete, __kernel_timespec* timeout) {
+    unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    io_uring_getevents_arg arg = {};
+    void* argp = nullptr;
+    size_t argsz = 0;
+    if (timeout != nullptr) {
+      flags |= IORING_ENTER_EXT_ARG;
+      arg.ts = reinterpret_cast<uintptr_t>(timeout);
+      argp = &arg;
+      argsz = sizeof(arg);
+    }
+
+    long submitted = syscall(SYS_io_uring_enter, ring_fd_, to_submit_,
+                             min_complete, flags, argp, argsz);
+    if (submitted < 0) {
+      if (errno == EINTR || errno == ETIME || errno == EAGAIN ||
+          errno == EBUSY) {
+        return false;
+      }
+      Fatal("io_uring_enter");
+    }
+    to_submit_ -= submitted;
+    return true;
+  }
+
+  size_t Complete(std::vector<ChildExit>* exits) {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      return 0;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    size_t reaped = 0;
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+      auto it = waiting_.find(cqe.user_data);
+      if (cqe.res < 0) {
+        errno = -cqe.res;
+        Fatal("waitid");
+      }
+      const auto& waiting = it->second;
+      siginfo_t info = {};
+      rusage usage = {};
+      const bool by_pidfd = waiting.pidfd >= 0;
+      if (WaitidWithUsage(by_pidfd ? P_PIDFD : P_PID,
+                          by_pidfd ? waiting.pidfd : waiting.pid, &info,
+                          WEXITED | WNOHANG, &usage) != 0) {
+        Fatal("waitid");
+      }
+      exits->push_back({waiting.token, WaitStatus(info), now, usage});
+      if (by_pidfd) {
+        close(waiting.pidfd);
+      }
+      waiting_.erase(it);
+      reaped++;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return reaped;
+  }
+
+  int ring_fd_ = -1;
+  void* sq_ring_ = nullptr;
+  void* cq_ring_ = nullptr;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  size_t cq_ring_size_ = 0;
+  size_t sqes_size_ = 0;
+
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned sq_entries_ = 0;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+
+  unsigned to_submit_ = 0;
+  uint64_t next_id_ = 0;
+  // Exits completed while making room to submit, not yet returned by Reap().
+  std::vector<ChildExit> early_exits_;
+  // Node based, so that the siginfo the kernel writes to stays put.
+  std::unordered_map<uint64_t, Waiting> waiting_;
+};
+
+}  // namespace
+
+const char* ReactorEngineName(ReactorEngine engine) {
+  switch (engine) {
+    case ReactorEngine::kEpoll:
+      return "epoll";
+    case ReactorEngine::kIoUring:
+      return "io_uring";
+  }
+  return "unknown";
+}
+
+bool ParseReactorEngine(const std::string& name, ReactorEngine* engine) {
+  for (auto candidate : {ReactorEngine::kEpoll, ReactorEngine::kIoUring}) {
+    if (name == ReactorEngineName(candidate)) {
+      *engine = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PidfdsSupported() {
+  static const bool supported = [] {
+    int probe = PidfdOpen(getpid());
+    if (probe < 0) {
+      return false;
+    }
+    close(probe);
+    return true;
+  }();
+  return supported;
+}
+
+std::unique_ptr<Reactor> CreateReactor(ReactorEngine engine) {
+  if (engine == ReactorEngine::kIoUring) {
+    auto reactor = std::make_unique<IoUringReactor>();
+    if (reactor->Init()) {
+      return reactor;
+    }
+    std::cerr << "io_uring with IORING_OP_WAITID is not available, using epoll"
+              << std::endl;
+  }
+  return std::make_unique<EpollReactor>();
+}
@@ -0,0 +1,85 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Event loop that reaps children as they exit, so that no thread has to sit
+// in a blocking wait per child.
+
+#pragma once
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "spawn.h"
+
+struct ChildExit {
+  // The token the child was watched with.
+  uint64_t token = 0;
+  // Wait status, as returned by waitpid().
+  int status = 0;
+  // When the reactor noticed the exit.
+  std::chrono::steady_clock::time_point end_time;
+  // Resources used by the child and the descendants it waited for.
+  rusage usage = {};
+};
+
+class Reactor {
+ public:
+  virtual ~Reactor() = default;
+
+  // Starts watching a child returned by Spawn(). Takes ownership of its pidfd.
+  virtual void Watch(const SpawnedChild& child, uint64_t token) = 0;
+
+  // Reaps the watched children that have exited and appends them to exits.
+  // If none has exited yet, waits until one does or the deadline passes;
+  // kNoWait returns right away and kForever waits without limit. Deadlines
+  // are kept with a high resolution timer, not rounded to milliseconds.
+  // Returns the number of children reaped.
+  virtual size_t Reap(std::chrono::steady_clock::time_point deadline,
+                      std::vector<ChildExit>* exits) = 0;
+
+  static constexpr auto kNoWait = std::chrono::steady_clock::time_point::min();
+  static constexpr auto kForever = std::chrono::steady_clock::time_point::max();
+};
+
+enum class ReactorEngine {
+  // Watches pidfds and a timerfd for deadlines with epoll. Where pidfds are
+  // not available (before Linux 5.3) it falls back to a signalfd for
+  // SIGCHLD; that mode blocks SIGCHLD, so the reactor must be created before
+  // any other thread is started.
+  kEpoll,
+  // Waits with IORING_OP_WAITID on one io_uring, so submitting a wait, the
+  // exit itself and the deadline all go through a single io_uring_enter().
+  // Each exited child then takes one waitid() to reap it with its rusage.
+  // Needs Linux 6.7; falls back to epoll elsewhere.
+  kIoUring,
+};
+
+constexpr ReactorEngine kDefaultReactorEngine = ReactorEngine::kEpoll;
+
+const char* ReactorEngineName(ReactorEngine engine);
+
+// Parses "epoll" or "io_uring". Returns false for anything else.
+bool ParseReactorEngine(const std::string& name, ReactorEngine* engine);
+
+std::unique_ptr<Reactor> CreateReactor(ReactorEngine engine);
+
+// Whether reactors can watch children by pidfd. Without pidfds an epoll
+// reactor reaps through SIGCHLD, which reaches only one reactor per process,
+// so there must not be more than one.
+bool PidfdsSupported();
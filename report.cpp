@@ -0,0 +1,350 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "report.h"
+
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iterator>
+#include <sstream>
+#include <thread>
+
+const ReportPercentile kReportPercentiles[5] = {
+    {"p50", 50}, {"p90", 90}, {"p99", 99}, {"p99.9", 99.9}, {"p99.99", 99.99},
+};
+
+namespace {
+
+// JSON string literal.
+std::string Quote(const std::string& value) {
+  std::string quoted = "\"";
+  for (unsigned char c : value) {
+    switch (c) {
+      case '"':
+        quoted += "\\\"";
+        break;
+      case '\\':
+        quoted += "\\\\";
+        break;
+      case '\n':
+        quoted += "\\n";
+        break;
+      case '\t':
+        quoted += "\\t";
+        break;
+      default:
+        if (c < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          quoted += escaped;
+        } else {
+          quoted += static_cast<char>(c);
+        }
+    }
+  }
+  return quoted + "\"";
+}
+
+// CSV field, quoted when it has to be.
+std::string CsvField(const std::string& value) {
+  if (value.find_first_of(",\"\n") == std::string::npos) {
+    return value;
+  }
+  std::string quoted = "\"";
+  for (char c : value) {
+    quoted += c;
+    if (c == '"') {
+      quoted += '"';
+    }
+  }
+  return quoted + "\"";
+}
+
+// ISO 8601 in UTC, e.g. 2024-05-01T12:00:00Z.
+std::string FormatTime(std::chrono::system_clock::time_point time) {
+  const std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+  std::tm utc;
+  gmtime_r(&seconds, &utc);
+  char buffer[32];
+  strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &utc);
+  return buffer;
+}
+
+// "p99.9" -> "p99_9", so that it can be a field name.
+std::string FieldName(const char* name) {
+  std::string field = name;
+  for (char& c : field) {
+    if (c == '.') {
+      c = '_';
+    }
+  }
+  return field;
+}
+
+double PerSecond(size_t count, const RunInfo& info) {
+  return info.elapsed.count() > 0 ? count / info.elapsed.count() : 0;
+}
+
+struct MetadataField {
+  std::string key;
+  // Unquoted: each format quotes text its own way.
+  std::string value;
+  // A string rather than a number.
+  bool text;
+};
+
+// Fields shared by both formats.
+std::vector<MetadataField> Metadata(const RunInfo& info) {
+  const auto& options = info.options;
+  const auto distribution =
+      CreateDistribution(options.distribution, options.precision);
+  const double launched = std::max<size_t>(1, info.overhead.launched);
+  std::ostringstream launch, reap, elapsed, error, rate;
+  launch << std::chrono::duration<double, std::milli>(info.overhead.launch)
+                    .count() /
+                launched;
+  reap << std::chrono::duration<double, std::milli>(info.overhead.reap)
+                  .count() /
+              launched;
+  elapsed << info.elapsed.count();
+  error << distribution->RelativeError();
+  rate << options.rate;
+
+  std::string command_line;
+  for (const auto& arg : info.command_line) {
+    command_line += (command_line.empty() ? "" : " ") + arg;
+  }
+  return {
+      {"command_line", command_line, true},
+      {"start_time", FormatTime(info.start_time), true},
+      {"elapsed_s", elapsed.str(), false},
+      {"host", info.host, true},
+      {"kernel", info.kernel, true},
+      {"cpus", std::to_string(info.cpus), false},
+      {"slots", std::to_string(options.slots), false},
+      {"launchers", std::to_string(options.launchers), false},
+      {"rate", rate.str(), false},
+      {"arrival", ArrivalName(options.arrival), true},
+      {"spawn", SpawnBackendName(options.spawn.backend), true},
+      {"engine", ReactorEngineName(options.engine), true},
+      {"distribution", distribution->name(), true},
+      {"relative_error", error.str(), false},
+      {"launch_overhead_ms", launch.str(), false},
+      {"reap_overhead_ms", reap.str(), false},
+  };
+}
+
+void WriteLatency(std::ostream& out, const Stats& stats) {
+  out << "{\"count\": " << stats.count;
+  if (stats.count > 0) {
+    out << ", \"min_us\": " << stats.min_us << ", \"avg_us\": "
+        << static_cast<double>(stats.total_us) / stats.count;
+    for (const auto& percentile : kReportPercentiles) {
+      out << ", \"" << FieldName(percentile.name)
+          << "_us\": " << stats.PercentileUs(percentile.percentile);
+    }
+    out << ", \"max_us\": " << stats.max_us;
+  }
+  out << ", \"buckets\": [";
+  bool first = true;
+  for (const auto& bucket : stats.distribution->Buckets()) {
+    out << (first ? "" : ", ") << "[" << bucket.high << ", " << bucket.count
+        << "]";
+    first = false;
+  }
+  out << "]}";
+}
+
+void WriteRow(std::ostream& out, const RunInfo& info, const ReportRow& row) {
+  const auto& stats = row.stats;
+  const auto& usage = stats.usage;
+  out << "{\"name\": " << Quote(row.name)
+      << ", \"count\": " << stats.invocations()
+      << ", \"errors\": " << stats.failures()
+      << ", \"exited_nonzero\": " << stats.exited_nonzero
+      << ", \"killed\": " << stats.killed
+      << ", \"not_spawned\": " << stats.not_spawned
+      << ", \"ops_per_s\": " << PerSecond(stats.invocations(), info)
+      << ", \"goodput_per_s\": " << PerSecond(stats.service.count, info)
+      << ",\n      \"service\": ";
+  WriteLatency(out, stats.service);
+  out << ",\n      \"response\": ";
+  WriteLatency(out, stats.response);
+  out << ",\n      \"failed\": ";
+  WriteLatency(out, stats.failed);
+  out << ",\n      \"usage\": {\"count\": " << usage.count
+      << ", \"wall_us\": " << usage.wall_us
+      << ", \"user_us\": " << usage.user_us
+      << ", \"system_us\": " << usage.system_us
+      << ", \"max_rss_kb\": " << usage.max_rss_kb
+      << ", \"minor_faults\": " << usage.minor_faults
+      << ", \"major_faults\": " << usage.major_faults
+      << ", \"voluntary_switches\": " << usage.voluntary_switches
+      << ", \"involuntary_switches\": " << usage.involuntary_switches << "}";
+  if (info.options.perf.any()) {
+    out << ",\n      \"perf\": {";
+    bool first = true;
+    for (int event = 0; event < kPerfEventCount; ++event) {
+      if (stats.perf.counts[event] == 0) {
+        continue;
+      }
+      out << (first ? "" : ", ") << Quote(PerfEventName(event))
+          << ": {\"count\": " << stats.perf.counts[event]
+          << ", \"sum\": " << stats.perf.sums[event] << "}";
+      first = false;
+    }
+    out << "}";
+  }
+  out << "}";
+}
+
+void WriteCsvRow(std::ostream& out, const RunInfo& info,
+                 const ReportRow& row) {
+  const auto& stats = row.stats;
+  const auto& service = stats.service;
+  const auto& usage = stats.usage;
+  out << CsvField(row.name) << "," << stats.invocations() << ","
+      << stats.failures() << "," << stats.exited_nonzero << ","
+      << stats.killed << "," << stats.not_spawned << ","
+      << PerSecond(stats.invocations(), info) << ","
+      << PerSecond(service.count, info);
+  for (const Stats* latency : {&stats.service, &stats.response}) {
+    if (latency->count == 0) {
+      out << std::string(3 + std::size(kReportPercentiles), ',');
+      continue;
+    }
+    out << "," << latency->min_us << ","
+        << static_cast<double>(latency->total_us) / latency->count;
+    for (const auto& percentile : kReportPercentiles) {
+      out << "," << latency->PercentileUs(percentile.percentile);
+    }
+    out << "," << latency->max_us;
+  }
+  out << "," << usage.count << "," << usage.wall_us << "," << usage.user_us
+      << "," << usage.system_us << "," << usage.max_rss_kb << ","
+      << usage.minor_faults << "," << usage.major_faults << ","
+      << usage.voluntary_switches << "," << usage.involuntary_switches;
+  for (int event = 0; event < kPerfEventCount; ++event) {
+    out << "," << stats.perf.counts[event] << "," << stats.perf.sums[event];
+  }
+  out << "\n";
+}
+
+}  // namespace
+
+void DescribeHost(RunInfo* info) {
+  char host[256] = {};
+  if (gethostname(host, sizeof(host) - 1) == 0) {
+    info->host = host;
+  }
+  utsname name;
+  if (uname(&name) == 0) {
+    info->kernel = std::string(name.sysname) + " " + name.release + " " +
+                   name.version + " " + name.machine;
+  }
+  info->cpus = std::thread::hardware_concurrency();
+}
+
+const char* OutputFormatName(OutputFormat format) {
+  switch (format) {
+    case OutputFormat::kText:
+      return "text";
+    case OutputFormat::kJson:
+      return "json";
+    case OutputFormat::kCsv:
+      return "csv";
+  }
+  return "unknown";
+}
+
+bool ParseOutputFormat(const std::string& name, OutputFormat* format) {
+  for (auto candidate :
+       {OutputFormat::kText, OutputFormat::kJson, OutputFormat::kCsv}) {
+    if (name == OutputFormatName(candidate)) {
+      *format = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+void WriteJson(std::ostream& out, const RunInfo& info,
+               const std::vector<ReportRow>& rows, const ReportRow& all) {
+  out << "{\n  \"metadata\": {";
+  bool first = true;
+  for (const auto& field : Metadata(info)) {
+    out << (first ? "\n" : ",\n") << "    " << Quote(field.key) << ": "
+        << (field.text ? Quote(field.value) : field.value);
+    first = false;
+  }
+  out << "\n  },\n  \"commands\": [";
+  first = true;
+  for (const auto& row : rows) {
+    out << (first ? "\n" : ",\n") << "    ";
+    WriteRow(out, info, row);
+    first = false;
+  }
+  out << "\n  ],\n  \"all\": ";
+  WriteRow(out, info, all);
+  out << ",\n  \"intervals\": [";
+  first = true;
+  for (const auto& interval : info.intervals) {
+    const auto& latency = interval.latency;
+    out << (first ? "\n" : ",\n") << "    {\"end_s\": "
+        << std::chrono::duration<double>(interval.end).count()
+        << ", \"length_s\": "
+        << std::chrono::duration<double>(interval.length).count()
+        << ", \"succeeded\": " << latency.count
+        << ", \"errors\": " << interval.failures;
+    if (latency.count > 0) {
+      out << ", \"p50_us\": " << latency.PercentileUs(50)
+          << ", \"p99_us\": " << latency.PercentileUs(99);
+    }
+    out << "}";
+    first = false;
+  }
+  out << "\n  ]\n}" << std::endl;
+}
+
+void WriteCsv(std::ostream& out, const RunInfo& info,
+              const std::vector<ReportRow>& rows, const ReportRow& all) {
+  for (const auto& field : Metadata(info)) {
+    out << "# " << field.key << "," << CsvField(field.value) << "\n";
+  }
+  out << "name,count,errors,exited_nonzero,killed,not_spawned,ops_per_s,"
+         "goodput_per_s";
+  for (const char* latency : {"service", "response"}) {
+    out << "," << latency << "_min_us," << latency << "_avg_us";
+    for (const auto& percentile : kReportPercentiles) {
+      out << "," << latency << "_" << FieldName(percentile.name) << "_us";
+    }
+    out << "," << latency << "_max_us";
+  }
+  out << ",usage_count,wall_us,user_us,system_us,max_rss_kb,minor_faults,"
+         "major_faults,voluntary_switches,involuntary_switches";
+  for (int event = 0; event < kPerfEventCount; ++event) {
+    out << "," << PerfEventName(event) << "_count," << PerfEventName(event)
+        << "_sum";
+  }
+  out << "\n";
+  for (const auto& row : rows) {
+    WriteCsvRow(out, info, row);
+  }
+  WriteCsvRow(out, info, all);
+  out.flush();
+}
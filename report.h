@@ -0,0 +1,80 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Machine readable summaries of a run, for dashboards and for comparing
+// runs.
+
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "scheduler.h"
+
+// Percentiles reported next to min, average and max.
+struct ReportPercentile {
+  const char* name;
+  double percentile;
+};
+extern const ReportPercentile kReportPercentiles[5];
+
+// One label or command, or all of them.
+// The name of the row that merges every command, which no command may take.
+constexpr char kAllRowName[] = "all";
+
+struct ReportRow {
+  std::string name;
+  CommandStats stats;
+};
+
+// How the run was set up and where it ran.
+struct RunInfo {
+  std::vector<std::string> command_line;
+  std::chrono::system_clock::time_point start_time;
+  std::chrono::duration<double> elapsed{0};
+  std::string host;
+  // uname: sysname, release, version and machine.
+  std::string kernel;
+  unsigned cpus = 0;
+  SchedulerOptions options;
+  Overhead overhead;
+  std::vector<IntervalStats> intervals;
+};
+
+// Fills in the host, the kernel and the CPU count.
+void DescribeHost(RunInfo* info);
+
+enum class OutputFormat {
+  kText,
+  kJson,
+  kCsv,
+};
+
+const char* OutputFormatName(OutputFormat format);
+
+// Parses "text", "json" or "csv". Returns false for anything else.
+bool ParseOutputFormat(const std::string& name, OutputFormat* format);
+
+// One object with "metadata", "commands" (rows), "all" and "intervals".
+// Latencies are in microseconds and come with their histogram buckets as
+// [high, count] pairs.
+void WriteJson(std::ostream& out, const RunInfo& info,
+               const std::vector<ReportRow>& rows, const ReportRow& all);
+
+// "# key,value" metadata lines, a header, then one line per row and one for
+// all of them. Latencies are in microseconds; buckets are left out.
+void WriteCsv(std::ostream& out, const RunInfo& info,
+              const std::vector<ReportRow>& rows, const ReportRow& all);
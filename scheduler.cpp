@@ -0,0 +1,795 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "scheduler.h"
+
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+Stats::Stats(const Stats& other)
+    : count(other.count),
+      total_us(other.total_us),
+      min_us(other.min_us),
+      max_us(other.max_us),
+      distribution(other.distribution->Clone()) {}
+
+Stats& Stats::operator=(const Stats& other) {
+  if (this != &other) {
+    *this = Stats(other);
+  }
+  return *this;
+}
+
+void Stats::Record(long long elapsed_us) {
+  if (count == 0) {
+    min_us = max_us = elapsed_us;
+  } else {
+    min_us = std::min(min_us, elapsed_us);
+    max_us = std::max(max_us, elapsed_us);
+  }
+  total_us += elapsed_us;
+  count++;
+  distribution->Record(elapsed_us);
+}
+
+void Stats::Merge(const Stats& other) {
+  if (other.count == 0) {
+    return;
+  }
+  if (count == 0) {
+    min_us = other.min_us;
+    max_us = other.max_us;
+  } else {
+    min_us = std::min(min_us, other.min_us);
+    max_us = std::max(max_us, other.max_us);
+  }
+  total_us += other.total_us;
+  count += other.count;
+  distribution->Merge(*other.distribution);
+}
+
+long long Stats::PercentileUs(double percentile) const {
+  return std::clamp<long long>(distribution->ValueAtPercentile(percentile),
+                               min_us, max_us);
+}
+
+const char* ArrivalName(Arrival arrival) {
+  switch (arrival) {
+    case Arrival::kFixed:
+      return "fixed";
+    case Arrival::kPoisson:
+      return "poisson";
+  }
+  return "unknown";
+}
+
+bool ParseArrival(const std::string& name, Arrival* arrival) {
+  for (auto candidate : {Arrival::kFixed, Arrival::kPoisson}) {
+    if (name == ArrivalName(candidate)) {
+      *arrival = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* PairOrderName(PairOrder order) {
+  switch (order) {
+    case PairOrder::kAlternate:
+      return "alternate";
+    case PairOrder::kRandom:
+      return "random";
+  }
+  return "unknown";
+}
+
+bool ParsePairOrder(const std::string& name, PairOrder* order) {
+  for (auto candidate : {PairOrder::kAlternate, PairOrder::kRandom}) {
+    if (name == PairOrderName(candidate)) {
+      *order = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+namespace {
+
+long long Microseconds(const timeval& time) {
+  return time.tv_sec * 1000000LL + time.tv_usec;
+}
+
+}  // namespace
+
+void Usage::Record(const rusage& usage, long long wall) {
+  count++;
+  wall_us += wall;
+  user_us += Microseconds(usage.ru_utime);
+  system_us += Microseconds(usage.ru_stime);
+  max_rss_kb = std::max(max_rss_kb, usage.ru_maxrss);
+  minor_faults += usage.ru_minflt;
+  major_faults += usage.ru_majflt;
+  voluntary_switches += usage.ru_nvcsw;
+  involuntary_switches += usage.ru_nivcsw;
+}
+
+void Usage::Merge(const Usage& other) {
+  count += other.count;
+  wall_us += other.wall_us;
+  user_us += other.user_us;
+  system_us += other.system_us;
+  max_rss_kb = std::max(max_rss_kb, other.max_rss_kb);
+  minor_faults += other.minor_faults;
+  major_faults += other.major_faults;
+  voluntary_switches += other.voluntary_switches;
+  involuntary_switches += other.involuntary_switches;
+}
+
+void CommandStats::Merge(const CommandStats& other) {
+  service.Merge(other.service);
+  response.Merge(other.response);
+  failed.Merge(other.failed);
+  exited_nonzero += other.exited_nonzero;
+  killed += other.killed;
+  not_spawned += other.not_spawned;
+  usage.Merge(other.usage);
+  perf.Merge(other.perf);
+}
+
+void IntervalStats::Merge(const IntervalStats& other) {
+  latency.Merge(other.latency);
+  failures += other.failures;
+}
+
+namespace {
+
+// Lets writers update whichever of two buffers is active without locks,
+// while a reader swaps them and waits for writers still in the old one to
+// leave (Gil Tene's WriterReaderPhaser, from HdrHistogram). Writers only do
+// two atomic increments; a single reader at a time may flip.
+class WriterReaderPhaser {
+ public:
+  // Returns the value to pass to WriterExit().
+  int64_t WriterEnter() { return start_epoch_.fetch_add(1); }
+
+  void WriterExit(int64_t critical_value) {
+    (critical_value < 0 ? odd_end_epoch_ : even_end_epoch_).fetch_add(1);
+  }
+
+  // Returns once every writer that entered before the flip has exited.
+  void FlipPhase() {
+    const bool next_phase_is_even = start_epoch_.load() < 0;
+    const int64_t initial =
+        next_phase_is_even ? 0 : std::numeric_limits<int64_t>::min();
+    (next_phase_is_even ? even_end_epoch_ : odd_end_epoch_).store(initial);
+    const int64_t start_at_flip = start_epoch_.exchange(initial);
+    const auto& old_end = next_phase_is_even ? odd_end_epoch_ : even_end_epoch_;
+    while (old_end.load() != start_at_flip) {
+      std::this_thread::yield();
+    }
+  }
+
+ private:
+  std::atomic<int64_t> start_epoch_{0};
+  std::atomic<int64_t> even_end_epoch_{0};
+  std::atomic<int64_t> odd_end_epoch_{std::numeric_limits<int64_t>::min()};
+};
+
+// Interval stats of one launcher: it records into the active buffer and the
+// reporter swaps in a fresh one to read the other.
+class IntervalRecorder {
+ public:
+  IntervalRecorder(DistributionKind kind, int precision)
+      : kind_(kind), precision_(precision) {
+    buffers_[0] = IntervalStats(kind, precision);
+    buffers_[1] = IntervalStats(kind, precision);
+  }
+
+  void RecordLatency(long long elapsed_us) {
+    const int64_t critical = phaser_.WriterEnter();
+    buffers_[active_.load(std::memory_order_acquire)].latency.Record(
+        elapsed_us);
+    phaser_.WriterExit(critical);
+  }
+
+  void RecordFailure() {
+    const int64_t critical = phaser_.WriterEnter();
+    buffers_[active_.load(std::memory_order_acquire)].failures++;
+    phaser_.WriterExit(critical);
+  }
+
+  // Reporter only: adds what was recorded since the last call to *total.
+  void Sample(IntervalStats* total) {
+    const int old = active_.load();
+    buffers_[1 - old] = IntervalStats(kind_, precision_);
+    active_.store(1 - old, std::memory_order_release);
+    phaser_.FlipPhase();
+    total->Merge(buffers_[old]);
+  }
+
+ private:
+  const DistributionKind kind_;
+  const int precision_;
+  WriterReaderPhaser phaser_;
+  std::atomic<int> active_{0};
+  IntervalStats buffers_[2];
+};
+
+// Jobs queued on one launcher. The owner takes from the front so that its
+// jobs start in queue order; thieves take from the back.
+class JobDeque {
+ public:
+  void Push(size_t job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(job);
+  }
+
+  bool Pop(size_t* job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (jobs_.empty()) {
+      return false;
+    }
+    *job = jobs_.front();
+    jobs_.pop_front();
+    return true;
+  }
+
+  // Moves the back half of the jobs, rounded up, to *stolen.
+  void StealHalf(std::vector<size_t>* stolen) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const size_t count = (jobs_.size() + 1) / 2;
+    stolen->assign(jobs_.end() - count, jobs_.end());
+    jobs_.erase(jobs_.end() - count, jobs_.end());
+  }
+
+ private:
+  std::mutex mutex_;
+  std::deque<size_t> jobs_;
+};
+
+struct Shared {
+  const std::vector<CommandPlan>& plans;
+  const std::vector<Job>& jobs;
+  const SchedulerOptions& options;
+  std::vector<std::unique_ptr<JobDeque>> queues;
+  // Open loop arrival schedules count from here.
+  std::chrono::steady_clock::time_point start_time;
+};
+
+class Launcher {
+ public:
+  // arrivals is this launcher's share of the open loop arrivals, or
+  // Job::kUnbounded to keep going until the deadline.
+  Launcher(size_t id, size_t slots, size_t arrivals, Shared& shared)
+      : id_(id),
+        perf_(shared.options.perf.any()),
+        spawn_options_(shared.options.spawn),
+        slots_(slots),
+        arrivals_(arrivals),
+        shared_(shared),
+        reactor_(CreateReactor(shared.options.engine)),
+        stats_(shared.plans.size(), CommandStats(shared.options.distribution,
+                                                  shared.options.precision)),
+        interval_(shared.options.distribution, shared.options.precision),
+        random_(std::random_device()() + id) {
+    // Held children wait for their counters before they exec.
+    spawn_options_.hold_exec = perf_;
+    if (shared.options.event_log != nullptr) {
+      log_ = shared.options.event_log->NewWriter();
+    }
+    for (size_t slot = slots; slot > 0; --slot) {
+      free_.push_back(slot - 1);
+    }
+  }
+
+  const Overhead& overhead() const { return overhead_; }
+  IntervalRecorder& interval() { return interval_; }
+  const std::vector<CommandStats>& stats() const { return stats_; }
+
+  void Run() {
+    if (shared_.options.rate > 0) {
+      RunOpenLoop();
+    } else {
+      RunClosedLoop();
+    }
+  }
+
+ private:
+  void RunClosedLoop() {
+    size_t job;
+    while (true) {
+      while (!free_.empty() && NextJob(&job)) {
+        const size_t slot = free_.back();
+        free_.pop_back();
+        const auto& queued = shared_.jobs[job];
+        slots_[slot].job = job;
+        slots_[slot].remaining = queued.iterations;
+        slots_[slot].pairs = 0;
+        slots_[slot].pair_open = false;
+        // A pair takes two launches.
+        if (queued.paired_plan != Job::kUnpaired &&
+            queued.iterations != Job::kUnbounded) {
+          slots_[slot].remaining *= 2;
+        }
+        Launch(slot);
+        // Pick up children that exit while we are still filling slots, so
+        // that they are not timed late.
+        Reap(Reactor::kNoWait);
+      }
+      // Jobs are never queued after the start, so with nothing running and
+      // nothing left to take we are done.
+      if (running_ == 0) {
+        break;
+      }
+      Reap(Reactor::kForever);
+    }
+  }
+
+  // Launches arrivals on schedule, however many are still running. Each
+  // launcher serves rate / launchers of the arrivals; fixed schedules are
+  // phase shifted so that the launchers interleave evenly.
+  void RunOpenLoop() {
+    const auto& options = shared_.options;
+    const size_t launchers = shared_.queues.size();
+    const std::chrono::duration<double> mean_gap(launchers / options.rate);
+    std::exponential_distribution<double> poisson_gap(1 / mean_gap.count());
+    auto next_gap = [&]() -> std::chrono::steady_clock::duration {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          options.arrival == Arrival::kPoisson
+              ? std::chrono::duration<double>(poisson_gap(random_))
+              : mean_gap);
+    };
+
+    auto next_arrival = shared_.start_time;
+    if (options.arrival == Arrival::kPoisson) {
+      next_arrival += next_gap();
+    } else {
+      next_arrival += std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::duration<double>(id_ / options.rate));
+    }
+    size_t left = arrivals_;
+    size_t job = id_;
+
+    while (true) {
+      while (left > 0 && next_arrival < options.deadline &&
+             next_arrival <= std::chrono::steady_clock::now()) {
+        const size_t slot = AcquireSlot();
+        slots_[slot].job = job % shared_.jobs.size();
+        slots_[slot].remaining = 1;
+        Launch(slot, next_arrival);
+        job += launchers;
+        if (left != Job::kUnbounded) {
+          left--;
+        }
+        next_arrival += next_gap();
+      }
+
+      const bool launched_all = left == 0 || next_arrival >= options.deadline;
+      if (launched_all && running_ == 0) {
+        break;
+      }
+      Reap(launched_all ? Reactor::kForever : next_arrival);
+    }
+  }
+
+  // A free slot, adding one if all are taken.
+  size_t AcquireSlot() {
+    if (free_.empty()) {
+      slots_.emplace_back();
+      return slots_.size() - 1;
+    }
+    const size_t slot = free_.back();
+    free_.pop_back();
+    return slot;
+  }
+
+  bool NextJob(size_t* job) {
+    auto& own = *shared_.queues[id_];
+    if (own.Pop(job)) {
+      return true;
+    }
+
+    const size_t count = shared_.queues.size();
+    for (size_t i = 1; i < count; ++i) {
+      shared_.queues[(id_ + i) % count]->StealHalf(&stolen_);
+      if (stolen_.empty()) {
+        continue;
+      }
+      *job = stolen_.front();
+      for (size_t j = 1; j < stolen_.size(); ++j) {
+        own.Push(stolen_[j]);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  // Starts the next iteration of the slot's job. Frees the slot once no
+  // iteration is left. intended_start is when the iteration was scheduled
+  // to start; kNow means it is meant to start right away.
+  static constexpr auto kNow = std::chrono::steady_clock::time_point::min();
+  void Launch(size_t slot_index,
+              std::chrono::steady_clock::time_point intended_start = kNow) {
+    auto& slot = slots_[slot_index];
+    for (; slot.remaining > 0; slot.remaining--) {
+      slot.start_time = std::chrono::steady_clock::now();
+      if (slot.start_time >= shared_.options.deadline) {
+        break;
+      }
+      slot.plan = NextPlan(&slot);
+      if (shared_.options.confidence &&
+          !shared_.options.confidence->Admit(slot.plan)) {
+        break;
+      }
+      const auto& plan = shared_.plans[slot.plan];
+      slot.intended_start =
+          intended_start == kNow ? slot.start_time : intended_start;
+
+      int error = 0;
+      auto child = Spawn(spawn_options_, plan, &error);
+      if (child.pid < 0) {
+        std::cerr << "Cannot run '" << plan.command()
+                  << "': " << strerror(error) << std::endl;
+        stats_[slot.plan].not_spawned++;
+        interval_.RecordFailure();
+        if (IsPaired(slot)) {
+          PairedExit(&slot, -1);
+        }
+        if (log_) {
+          EventRecord record = {};
+          record.status = -1;
+          Log(slot_index, slot.start_time, &record);
+        }
+        continue;
+      }
+      if (perf_) {
+        slot.perf.Attach(shared_.options.perf, child.pid,
+                         child.release_fd >= 0);
+        ReleaseChild(&child);
+      }
+      reactor_->Watch(child, slot_index);
+      slot.error_fd = child.error_fd;
+      running_++;
+      slot.remaining--;
+      overhead_.launch += std::chrono::steady_clock::now() - slot.start_time;
+      overhead_.launched++;
+      return;
+    }
+    free_.push_back(slot_index);
+  }
+
+  void Reap(std::chrono::steady_clock::time_point deadline) {
+    const auto reap_start = std::chrono::steady_clock::now();
+    running_ -= reactor_->Reap(deadline, &exits_);
+    for (const auto& exit : exits_) {
+      auto& slot = slots_[exit.token];
+      auto& stats = stats_[slot.plan];
+      ReportChildError(slot.error_fd, shared_.plans[slot.plan].command());
+      slot.error_fd = -1;
+      const auto service =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              exit.end_time - slot.start_time);
+      stats.usage.Record(exit.usage, service.count());
+      slot.perf.Collect(&stats.perf);
+      if (log_) {
+        EventRecord record = {};
+        record.status = exit.status;
+        record.user_us = Microseconds(exit.usage.ru_utime);
+        record.system_us = Microseconds(exit.usage.ru_stime);
+        record.max_rss_kb = exit.usage.ru_maxrss;
+        record.minor_faults = exit.usage.ru_minflt;
+        record.major_faults = exit.usage.ru_majflt;
+        record.voluntary_switches = exit.usage.ru_nvcsw;
+        record.involuntary_switches = exit.usage.ru_nivcsw;
+        Log(exit.token, exit.end_time, &record);
+      }
+      const auto response =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              exit.end_time - slot.intended_start);
+      const bool succeeded =
+          WIFEXITED(exit.status) && WEXITSTATUS(exit.status) == 0;
+      if (IsPaired(slot)) {
+        PairedExit(&slot, succeeded ? response.count() : -1);
+      }
+      if (succeeded) {
+        stats.service.Record(service.count());
+        stats.response.Record(response.count());
+        interval_.RecordLatency(response.count());
+        if (shared_.options.confidence) {
+          shared_.options.confidence->Record(slot.plan, response.count());
+        }
+        continue;
+      }
+      stats.failed.Record(service.count());
+      interval_.RecordFailure();
+      if (WIFSIGNALED(exit.status)) {
+        stats.killed++;
+      } else {
+        stats.exited_nonzero++;
+      }
+    }
+    // A blocking reap is only overhead from the moment a child had exited.
+    if (deadline == Reactor::kNoWait) {
+      overhead_.reap += std::chrono::steady_clock::now() - reap_start;
+    } else if (!exits_.empty()) {
+      overhead_.reap +=
+          std::chrono::steady_clock::now() - exits_.front().end_time;
+    }
+
+    // Slots with iterations left go again right away, back to back.
+    for (const auto& exit : exits_) {
+      Launch(exit.token);
+    }
+    exits_.clear();
+  }
+
+  // Fills in what the slot knows about its invocation and appends it.
+  void Log(size_t slot_index, std::chrono::steady_clock::time_point end_time,
+           EventRecord* record) {
+    const auto& slot = slots_[slot_index];
+    const auto since_start = [this](std::chrono::steady_clock::time_point t) {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 t - shared_.start_time)
+          .count();
+    };
+    record->command = slot.plan;
+    record->launcher = id_;
+    record->slot = slot_index;
+    record->intended_start_ns = since_start(slot.intended_start);
+    record->start_ns = since_start(slot.start_time);
+    record->end_ns = since_start(end_time);
+    log_->Append(*record);
+  }
+
+  struct Slot {
+    size_t job = 0;
+    // Of the running iteration.
+    size_t plan = 0;
+    // Launches of the job still to go: one per iteration, two per pair.
+    size_t remaining = 0;
+    // Pairs begun so far.
+    size_t pairs = 0;
+    // The first of a pair has been launched and the second not yet.
+    bool pair_open = false;
+    // The pair runs the paired plan first.
+    bool swapped = false;
+    // Response time of the first of the pair, -1 if it failed.
+    long long first_us = -1;
+    // Of the running iteration: when it was scheduled and actually launched.
+    std::chrono::steady_clock::time_point intended_start;
+    std::chrono::steady_clock::time_point start_time;
+    // Of the running iteration, for ReportChildError().
+    int error_fd = -1;
+    PerfCounters perf;
+  };
+
+  bool IsPaired(const Slot& slot) const {
+    return shared_.jobs[slot.job].paired_plan != Job::kUnpaired;
+  }
+
+  // The plan of the slot's next launch. Paired jobs alternate between their
+  // two plans, picking the order as each pair begins.
+  size_t NextPlan(Slot* slot) {
+    const auto& job = shared_.jobs[slot->job];
+    if (job.paired_plan == Job::kUnpaired) {
+      return job.plan;
+    }
+    if (slot->pair_open) {
+      slot->pair_open = false;
+      return slot->swapped ? job.plan : job.paired_plan;
+    }
+    slot->swapped = shared_.options.pair_order == PairOrder::kRandom
+                        ? (random_() & 1) != 0
+                        : (slot->pairs & 1) != 0;
+    slot->pairs++;
+    slot->pair_open = true;
+    slot->first_us = -1;
+    return slot->swapped ? job.paired_plan : job.plan;
+  }
+
+  // Called as each invocation of a paired job ends, with its response time
+  // or -1 if it failed. The second of a pair completes it.
+  void PairedExit(Slot* slot, long long response_us) {
+    if (slot->pair_open) {
+      slot->first_us = response_us;
+      return;
+    }
+    auto* paired = shared_.options.paired;
+    if (paired == nullptr) {
+      return;
+    }
+    if (slot->first_us < 0 || response_us < 0) {
+      paired->RecordBroken();
+    } else if (slot->swapped) {
+      paired->Record(response_us, slot->first_us);
+    } else {
+      paired->Record(slot->first_us, response_us);
+    }
+  }
+
+  const size_t id_;
+  const bool perf_;
+  SpawnOptions spawn_options_;
+  std::vector<Slot> slots_;
+  // Indexes of the slots without a job.
+  std::vector<size_t> free_;
+  const size_t arrivals_;
+  Shared& shared_;
+  std::unique_ptr<Reactor> reactor_;
+  size_t running_ = 0;
+  std::vector<CommandStats> stats_;
+  Overhead overhead_;
+  IntervalRecorder interval_;
+  std::unique_ptr<EventLogWriter> log_;
+  std::vector<ChildExit> exits_;
+  std::vector<size_t> stolen_;
+  std::mt19937_64 random_;
+};
+
+// Samples every launcher's interval stats on a thread of its own and hands
+// the sum to SchedulerOptions::on_interval. Does nothing without one.
+class IntervalReporter {
+ public:
+  IntervalReporter(const std::vector<std::unique_ptr<Launcher>>& launchers,
+                   std::chrono::steady_clock::time_point start_time,
+                   const SchedulerOptions& options)
+      : launchers_(launchers), start_time_(start_time), options_(options) {
+    if (options.interval.count() > 0 && options.on_interval) {
+      thread_ = std::thread(&IntervalReporter::Run, this);
+    }
+  }
+
+  ~IntervalReporter() { Stop(); }
+
+  // Reports the time left since the last interval and returns.
+  void Stop() {
+    if (!thread_.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopped_ = true;
+    }
+    wakeup_.notify_one();
+    thread_.join();
+  }
+
+ private:
+  void Run() {
+    auto last = start_time_;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      const auto next = last + options_.interval;
+      const bool stopped = wakeup_.wait_until(lock, next, [this] {
+        return stopped_;
+      });
+      const auto now = stopped ? std::chrono::steady_clock::now() : next;
+      IntervalStats total(options_.distribution, options_.precision);
+      for (const auto& launcher : launchers_) {
+        launcher->interval().Sample(&total);
+      }
+      total.end = now - start_time_;
+      total.length = now - last;
+      last = now;
+      if (!stopped || total.latency.count > 0 || total.failures > 0) {
+        options_.on_interval(total);
+      }
+      if (stopped) {
+        return;
+      }
+    }
+  }
+
+  const std::vector<std::unique_ptr<Launcher>>& launchers_;
+  const std::chrono::steady_clock::time_point start_time_;
+  const SchedulerOptions& options_;
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  bool stopped_ = false;
+  std::thread thread_;
+};
+
+}  // namespace
+
+size_t LauncherCount(const SchedulerOptions& options, size_t jobs) {
+  const bool open_loop = options.rate > 0;
+  const size_t slots =
+      open_loop ? 0 : (options.slots == 0 ? jobs : options.slots);
+  size_t count = options.launchers;
+  if (count == 0) {
+    count = std::max(1u, std::thread::hardware_concurrency());
+  }
+  if (!open_loop) {
+    count = std::max<size_t>(1, std::min(count, slots));
+  }
+  if (!PidfdsSupported()) {
+    count = 1;
+  }
+  return count;
+}
+
+void RunJobs(const std::vector<CommandPlan>& plans,
+             const std::vector<Job>& jobs, const SchedulerOptions& options,
+             std::vector<CommandStats>& stats, Overhead& overhead) {
+  const bool open_loop = options.rate > 0;
+  const size_t slots =
+      open_loop ? 0 : (options.slots == 0 ? jobs.size() : options.slots);
+  const size_t count = LauncherCount(options, jobs.size());
+
+  size_t arrivals = 0;
+  for (const auto& job : jobs) {
+    if (job.iterations == Job::kUnbounded) {
+      arrivals = Job::kUnbounded;
+      break;
+    }
+    arrivals += job.iterations;
+  }
+
+  Shared shared{plans, jobs, options, {}, {}};
+  for (size_t i = 0; i < count; ++i) {
+    shared.queues.push_back(std::make_unique<JobDeque>());
+  }
+  for (size_t job = 0; job < jobs.size(); ++job) {
+    shared.queues[job % count]->Push(job);
+  }
+
+  // Reactors are created here, before any launcher thread starts, because a
+  // signalfd reactor has to block SIGCHLD for every thread.
+  std::vector<std::unique_ptr<Launcher>> launchers;
+  for (size_t i = 0; i < count; ++i) {
+    const size_t share = slots / count + (i < slots % count ? 1 : 0);
+    const size_t arrival_share =
+        arrivals == Job::kUnbounded
+            ? arrivals
+            : arrivals / count + (i < arrivals % count ? 1 : 0);
+    launchers.push_back(
+        std::make_unique<Launcher>(i, share, arrival_share, shared));
+  }
+
+  shared.start_time = std::chrono::steady_clock::now();
+  IntervalReporter reporter(launchers, shared.start_time, options);
+  if (count == 1) {
+    launchers[0]->Run();
+  } else {
+    std::vector<std::thread> threads;
+    for (auto& launcher : launchers) {
+      threads.emplace_back(&Launcher::Run, launcher.get());
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+  reporter.Stop();
+
+  stats.assign(plans.size(),
+               CommandStats(options.distribution, options.precision));
+  for (const auto& launcher : launchers) {
+    for (size_t plan = 0; plan < plans.size(); ++plan) {
+      stats[plan].Merge(launcher->stats()[plan]);
+    }
+    overhead.launch += launcher->overhead().launch;
+    overhead.reap += launcher->overhead().reap;
+    overhead.launched += launcher->overhead().launched;
+  }
+}
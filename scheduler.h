@@ -0,0 +1,237 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Runs a queue of jobs in a bounded number of slots, spread over launcher
+// threads that steal queued jobs from each other.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "command.h"
+#include "confidence.h"
+#include "distribution.h"
+#include "event_log.h"
+#include "paired.h"
+#include "perf.h"
+#include "reactor.h"
+#include "spawn.h"
+
+// Latencies of every invocation of one command, across all its jobs and
+// iterations.
+struct Stats {
+  explicit Stats(DistributionKind kind = DistributionKind::kHistogram,
+                 int precision = kDefaultPrecision)
+      : distribution(CreateDistribution(kind, precision)) {}
+  Stats(const Stats& other);
+  Stats& operator=(const Stats& other);
+  Stats(Stats&&) = default;
+  Stats& operator=(Stats&&) = default;
+
+  size_t count = 0;
+  long long total_us = 0;
+  long long min_us = 0;
+  long long max_us = 0;
+  std::unique_ptr<Distribution> distribution;
+
+  void Record(long long elapsed_us);
+  // Both must have been created with the same kind and precision.
+  void Merge(const Stats& other);
+  // From the distribution, but never outside the exact min and max.
+  long long PercentileUs(double percentile) const;
+};
+
+// Resources used by the invocations of one command, summed so that they can
+// be reported per invocation.
+struct Usage {
+  size_t count = 0;
+  // From the launch to the exit, to relate CPU time to.
+  long long wall_us = 0;
+  long long user_us = 0;
+  long long system_us = 0;
+  // The largest of any invocation.
+  long max_rss_kb = 0;
+  long long minor_faults = 0;
+  long long major_faults = 0;
+  long long voluntary_switches = 0;
+  long long involuntary_switches = 0;
+
+  void Record(const rusage& usage, long long wall_us);
+  void Merge(const Usage& other);
+};
+
+// Everything recorded for one command.
+struct CommandStats {
+  explicit CommandStats(DistributionKind kind = DistributionKind::kHistogram,
+                        int precision = kDefaultPrecision)
+      : service(kind, precision),
+        response(kind, precision),
+        failed(kind, precision) {}
+
+  // Of the invocations that exited 0, from the launch to the exit.
+  Stats service;
+  // Of the same invocations, from the intended start to the exit. In open
+  // loop this adds the time an arrival waited because the scheduler was
+  // behind, which service time alone would hide (coordinated omission). In
+  // closed loop a slot intends to start right away, so both are the same.
+  Stats response;
+  // From the launch to the exit, of the invocations that exited non-zero or
+  // were killed by a signal.
+  Stats failed;
+  size_t exited_nonzero = 0;
+  size_t killed = 0;
+  // Spawn() failed, so there is no latency.
+  size_t not_spawned = 0;
+  // Of every invocation that ran, successful or not.
+  Usage usage;
+  // Likewise, with SchedulerOptions::perf.
+  PerfTotals perf;
+
+  size_t failures() const { return exited_nonzero + killed + not_spawned; }
+  size_t invocations() const { return service.count + failures(); }
+
+  void Merge(const CommandStats& other);
+};
+
+// What happened during one reporting interval, across all commands.
+struct IntervalStats {
+  explicit IntervalStats(DistributionKind kind = DistributionKind::kHistogram,
+                         int precision = kDefaultPrecision)
+      : latency(kind, precision) {}
+
+  // Since the start of the run, when the interval ended.
+  std::chrono::nanoseconds end{0};
+  std::chrono::nanoseconds length{0};
+  // Response time of the invocations that succeeded.
+  Stats latency;
+  size_t failures = 0;
+
+  void Merge(const IntervalStats& other);
+};
+
+// A queued unit of work: run a plan this many times back to back in one
+// slot.
+struct Job {
+  // Keep relaunching until SchedulerOptions::deadline, or until
+  // SchedulerOptions::confidence stops the plan.
+  static constexpr size_t kUnbounded = std::numeric_limits<size_t>::max();
+
+  static constexpr size_t kUnpaired = std::numeric_limits<size_t>::max();
+
+  size_t plan = 0;
+  size_t iterations = 1;
+  // Otherwise every iteration is a pair: plan and paired_plan back to back
+  // in the slot, in the order of SchedulerOptions::pair_order. Their
+  // response times go to SchedulerOptions::paired. Closed loop only.
+  size_t paired_plan = kUnpaired;
+};
+
+// Time the harness spends per job on top of the jobs' own run time.
+struct Overhead {
+  // In Spawn() and Reactor::Watch().
+  std::chrono::nanoseconds launch{0};
+  // Collecting exit statuses once the reactor has noticed them.
+  std::chrono::nanoseconds reap{0};
+  size_t launched = 0;
+};
+
+// How open loop arrivals are spaced.
+enum class Arrival {
+  // Evenly, one every 1/rate seconds.
+  kFixed,
+  // Exponentially distributed gaps with mean 1/rate, like independent
+  // clients.
+  kPoisson,
+};
+
+const char* ArrivalName(Arrival arrival);
+
+// Parses "fixed" or "poisson". Returns false for anything else.
+bool ParseArrival(const std::string& name, Arrival* arrival);
+
+// Which plan of a pair goes first.
+enum class PairOrder {
+  // The job's plan in even pairs and its paired plan in odd ones, so that
+  // each is first half the time.
+  kAlternate,
+  // Either, at random, for every pair.
+  kRandom,
+};
+
+const char* PairOrderName(PairOrder order);
+
+// Parses "alternate" or "random". Returns false for anything else.
+bool ParsePairOrder(const std::string& name, PairOrder* order);
+
+struct SchedulerOptions {
+  SpawnOptions spawn;
+  ReactorEngine engine = kDefaultReactorEngine;
+  // How many jobs may run at once. 0 starts every job at once.
+  size_t slots = 0;
+  // Launcher threads, each with its own reactor, queue and share of the
+  // slots. 0 uses one per CPU.
+  size_t launchers = 0;
+  // Nothing is launched from this point on. Children already running are
+  // still waited for.
+  std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::time_point::max();
+  // Open loop: launches per second across all launchers, each on schedule no
+  // matter how many earlier ones are still running. Slots are ignored and
+  // every iteration of every job becomes one arrival, with the jobs taken in
+  // turn. 0 runs closed loop.
+  double rate = 0;
+  Arrival arrival = Arrival::kFixed;
+  // How latencies are summarized, and to how many significant digits.
+  DistributionKind distribution = DistributionKind::kHistogram;
+  int precision = kDefaultPrecision;
+  // The counters to attach to every child, none by default. fork and clone3
+  // children are held until attached so that counting starts at their exec;
+  // posix_spawn and vfork children are attached once they have exec'd.
+  PerfSupport perf;
+  // With on_interval set, called every interval while the jobs run, from a
+  // thread of its own, and once more for whatever is left at the end.
+  // Launchers never block on it.
+  std::chrono::nanoseconds interval{0};
+  std::function<void(const IntervalStats&)> on_interval;
+  // Every invocation is appended here when set, with plans[p] logged as
+  // command p.
+  EventLog* event_log = nullptr;
+  // When set, every launch must be admitted by it and every successful
+  // response time is recorded in it. A job ends once its plan is refused.
+  ConfidenceTarget* confidence = nullptr;
+  // For jobs with a paired plan.
+  PairOrder pair_order = PairOrder::kAlternate;
+  PairedDifference* paired = nullptr;
+};
+
+// The number of launcher threads RunJobs() uses for that many jobs: the
+// requested count, or one per CPU, but never more than there are slots, and
+// only one without pidfds.
+size_t LauncherCount(const SchedulerOptions& options, size_t jobs);
+
+// Runs the jobs, starting the next one the moment a slot frees up. A slot
+// keeps relaunching its job until all iterations are done, and only then
+// takes the next job. Each launcher takes jobs from its own queue in order
+// and steals from the others when that runs dry. The number of threads does
+// not depend on the number of jobs. stats[p] receives every invocation of
+// plans[p].
+void RunJobs(const std::vector<CommandPlan>& plans,
+             const std::vector<Job>& jobs, const SchedulerOptions& options,
+             std::vector<CommandStats>& stats, Overhead& overhead);
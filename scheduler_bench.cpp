@@ -0,0 +1,121 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Measures launch throughput of the scheduler as launcher threads are added.
+//
+// One launcher is the single-queue design: one thread owns every slot and
+// the whole queue. With more launchers the slots and the queue are split
+// and idle launchers steal queued jobs.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+
+const auto kUsage =
+    R"(./scheduler_bench [-i <jobs>] [-j <slots>] [-l <max launchers>] [program]
+    Runs the program (default: true) as many times as there are jobs with
+    1, 2, 4, ... launcher threads and reports launches per second.)";
+
+void PrintUsageAndExit() {
+  std::cerr << "Invalid arguments" << std::endl << kUsage << std::endl;
+  _exit(1);
+}
+
+int main(int argc, char* argv[]) {
+  const size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+  size_t job_count = 20000;
+  size_t slots = 4 * cpus;
+  size_t max_launchers = cpus;
+  std::string program = "true";
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && (strcmp(argv[i], "-i") == 0 ||
+                         strcmp(argv[i], "-j") == 0 ||
+                         strcmp(argv[i], "-l") == 0)) {
+      try {
+        const int value = std::stoi(argv[i + 1]);
+        if (value < 1) {
+          PrintUsageAndExit();
+        }
+        if (argv[i][1] == 'i') {
+          job_count = value;
+        } else if (argv[i][1] == 'j') {
+          slots = value;
+        } else {
+          max_launchers = value;
+        }
+      } catch (const std::exception& e) {
+        PrintUsageAndExit();
+      }
+      i++;
+      continue;
+    }
+    if (argv[i][0] == '-') {
+      PrintUsageAndExit();
+    }
+    program = argv[i];
+  }
+
+  std::vector<CommandPlan> plans;
+  plans.emplace_back(program);
+  if (plans[0].empty()) {
+    PrintUsageAndExit();
+  }
+  PathResolver resolver;
+  if (int error = plans[0].Resolve(resolver); error != 0) {
+    std::cerr << "Cannot run '" << program << "': " << strerror(error)
+              << std::endl;
+    return error == ENOENT ? EXIT_ENOENT : EXIT_CANNOT_INVOKE;
+  }
+  const std::vector<Job> jobs(job_count, Job{0, 1});
+
+  std::cout << "Running '" << program << "' " << job_count << " times in "
+            << slots << " slots" << std::endl
+            << std::left << std::setw(14) << "launchers" << std::right
+            << std::setw(14) << "launches/s" << std::setw(14) << "speedup"
+            << std::endl;
+  double single = 0;
+  for (size_t launchers = 1; launchers <= max_launchers; launchers *= 2) {
+    SchedulerOptions options;
+    options.slots = slots;
+    options.launchers = launchers;
+    std::vector<CommandStats> stats;
+    Overhead overhead;
+
+    const auto start_time = std::chrono::steady_clock::now();
+    RunJobs(plans, jobs, options, stats, overhead);
+    const double rate =
+        job_count / std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start_time)
+                        .count();
+    if (launchers == 1) {
+      single = rate;
+    }
+
+    std::cout << std::left << std::setw(14) << launchers << std::right
+              << std::fixed << std::setprecision(1) << std::setw(14) << rate
+              << std::setw(13) << std::setprecision(2) << rate / single << "x"
+              << std::endl;
+  }
+
+  return 0;
+}
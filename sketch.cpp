@@ -0,0 +1,137 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "sketch.h"
+
+#include <algorithm>
+#include <cmath>
+
+Sketch::Sketch(int precision) {
+  alpha_ = std::pow(10.0, -std::clamp(precision, kMinPrecision, kMaxPrecision));
+  gamma_ = (1 + alpha_) / (1 - alpha_);
+  inverse_log_gamma_ = 1 / std::log(gamma_);
+}
+
+Sketch::Sketch(const Sketch& other)
+    : alpha_(other.alpha_),
+      inverse_log_gamma_(other.inverse_log_gamma_),
+      gamma_(other.gamma_),
+      total_(other.total_),
+      zero_count_(other.zero_count_),
+      chunks_(other.chunks_.size()) {
+  for (size_t chunk = 0; chunk < chunks_.size(); ++chunk) {
+    if (other.chunks_[chunk]) {
+      chunks_[chunk].reset(new uint64_t[kChunkSize]);
+      std::copy_n(other.chunks_[chunk].get(), kChunkSize,
+                  chunks_[chunk].get());
+    }
+  }
+}
+
+uint64_t& Sketch::BinAt(size_t key) {
+  const size_t chunk = key >> kChunkBits;
+  if (chunk >= chunks_.size()) {
+    chunks_.resize(chunk + 1);
+  }
+  if (!chunks_[chunk]) {
+    chunks_[chunk].reset(new uint64_t[kChunkSize]());
+  }
+  return chunks_[chunk][key & (kChunkSize - 1)];
+}
+
+int64_t Sketch::ValueOf(size_t key) const {
+  // The point of the bin within alpha of both of its bounds.
+  return std::llround(2 * std::pow(gamma_, key) / (gamma_ + 1));
+}
+
+void Sketch::Record(int64_t value) {
+  total_++;
+  if (value < 1) {
+    zero_count_++;
+    return;
+  }
+  BinAt(static_cast<size_t>(std::ceil(std::log(value) * inverse_log_gamma_)))++;
+}
+
+void Sketch::Merge(const Distribution& distribution) {
+  const auto& other = static_cast<const Sketch&>(distribution);
+  for (size_t chunk = 0; chunk < other.chunks_.size(); ++chunk) {
+    if (!other.chunks_[chunk]) {
+      continue;
+    }
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      if (other.chunks_[chunk][i] > 0) {
+        BinAt((chunk << kChunkBits) + i) += other.chunks_[chunk][i];
+      }
+    }
+  }
+  zero_count_ += other.zero_count_;
+  total_ += other.total_;
+}
+
+int64_t Sketch::ValueAtPercentile(double percentile) const {
+  if (total_ == 0) {
+    return 0;
+  }
+  percentile = std::clamp(percentile, 0.0, 100.0);
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(percentile / 100 * total_)));
+  uint64_t seen = zero_count_;
+  if (seen >= rank) {
+    return 0;
+  }
+  size_t last_key = 0;
+  for (size_t chunk = 0; chunk < chunks_.size(); ++chunk) {
+    if (!chunks_[chunk]) {
+      continue;
+    }
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      if (chunks_[chunk][i] == 0) {
+        continue;
+      }
+      last_key = (chunk << kChunkBits) + i;
+      seen += chunks_[chunk][i];
+      if (seen >= rank) {
+        return ValueOf(last_key);
+      }
+    }
+  }
+  return ValueOf(last_key);
+}
+
+std::vector<Bucket> Sketch::Buckets() const {
+  std::vector<Bucket> buckets;
+  if (zero_count_ > 0) {
+    buckets.push_back({0, zero_count_});
+  }
+  for (size_t chunk = 0; chunk < chunks_.size(); ++chunk) {
+    if (!chunks_[chunk]) {
+      continue;
+    }
+    for (size_t i = 0; i < kChunkSize; ++i) {
+      if (chunks_[chunk][i] > 0) {
+        // Integer values, so the bin of key k ends at floor(gamma^k).
+        buckets.push_back(
+            {static_cast<int64_t>(std::floor(
+                 std::pow(gamma_, (chunk << kChunkBits) + i))),
+             chunks_[chunk][i]});
+      }
+    }
+  }
+  return buckets;
+}
+
+std::unique_ptr<Distribution> Sketch::Clone() const {
+  return std::make_unique<Sketch>(*this);
+}
@@ -0,0 +1,73 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Quantile sketch with a relative error guarantee, after DDSketch (Masson,
+// Rim and Lee, VLDB 2019).
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "distribution.h"
+
+// Counts values in bins whose bounds grow geometrically by
+// gamma = (1 + alpha) / (1 - alpha), so every value is known to within a
+// relative error alpha whatever its magnitude. Bins are never folded, so the
+// guarantee holds over any range, and sketches with the same alpha merge
+// exactly. Bins are allocated a page at a time as values land in them, so
+// memory follows the range the values actually cover, about
+// ln(largest / smallest) / (2 alpha) bins of 8 bytes: 55 KiB for 10us to 10s
+// at alpha = 0.1%. Far outliers cost a page each.
+class Sketch : public Distribution {
+ public:
+  // alpha is 10^-precision, the resolution of a histogram with as many
+  // significant digits.
+  explicit Sketch(int precision = kDefaultPrecision);
+  Sketch(const Sketch& other);
+  Sketch& operator=(const Sketch&) = delete;
+
+  void Record(int64_t value) override;
+  // other must be a Sketch with the same precision.
+  void Merge(const Distribution& other) override;
+  int64_t ValueAtPercentile(double percentile) const override;
+  std::vector<Bucket> Buckets() const override;
+  double RelativeError() const override { return alpha_; }
+  const char* name() const override { return "sketch"; }
+  std::unique_ptr<Distribution> Clone() const override;
+
+ private:
+  // The count of the bin of key, allocating its chunk.
+  uint64_t& BinAt(size_t key);
+  // The value reported for the bin of key.
+  int64_t ValueOf(size_t key) const;
+
+  // Bins per chunk: 4 KiB.
+  static constexpr int kChunkBits = 9;
+  static constexpr size_t kChunkSize = size_t{1} << kChunkBits;
+
+  double alpha_;
+  // 1 / log(gamma).
+  double inverse_log_gamma_;
+  double gamma_;
+  uint64_t total_ = 0;
+  // Values below 1, which have no logarithm.
+  uint64_t zero_count_ = 0;
+  // The bin of key k counts values v >= 1 with ceil(log_gamma(v)) == k, so
+  // keys start at 0. chunks_[c] holds keys c * kChunkSize onwards; chunks
+  // nothing was recorded in are left unallocated.
+  std::vector<std::unique_ptr<uint64_t[]>> chunks_;
+};
@@ -0,0 +1,149 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "sketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "test_util.h"
+
+namespace {
+
+// The exact value at percentile of sorted values, ranked like
+// ValueAtPercentile().
+int64_t Exact(const std::vector<int64_t>& sorted, double percentile) {
+  const auto rank = std::max<size_t>(
+      1, static_cast<size_t>(std::ceil(percentile / 100 * sorted.size())));
+  return sorted[rank - 1];
+}
+
+// Log-uniform values spanning seven decades: some 800000 bins at precision
+// 5.
+std::vector<int64_t> WideValues() {
+  std::mt19937_64 random(42);
+  std::uniform_real_distribution<double> exponent(0, 7);
+  std::vector<int64_t> values(100000);
+  for (auto& value : values) {
+    value = std::llround(std::pow(10.0, exponent(random)));
+  }
+  return values;
+}
+
+void TestErrorBoundOverAnyRange() {
+  auto values = WideValues();
+  for (int precision = kMinPrecision; precision <= kMaxPrecision;
+       ++precision) {
+    Sketch sketch(precision);
+    for (auto value : values) {
+      sketch.Record(value);
+    }
+    std::sort(values.begin(), values.end());
+    const double alpha = sketch.RelativeError();
+    CHECK_NEAR(alpha, std::pow(10.0, -precision), 1e-12);
+    for (double percentile :
+         {0.0, 1.0, 10.0, 50.0, 90.0, 99.0, 99.9, 99.99, 100.0}) {
+      const auto exact = Exact(values, percentile);
+      // Rounded to the nearest integer.
+      CHECK_NEAR(sketch.ValueAtPercentile(percentile), exact,
+                 alpha * exact + 0.5);
+    }
+  }
+}
+
+// A narrow band of small values next to a few far larger ones at the finest
+// precision, which a sketch folding its lowest bins would get wrong.
+void TestSmallValuesBesideOutliers() {
+  Sketch sketch(5);
+  for (int i = 0; i < 1000; ++i) {
+    sketch.Record(400 + i % 100);
+  }
+  sketch.Record(20000);
+  sketch.Record(86400000000LL);
+  const auto p50 = sketch.ValueAtPercentile(50);
+  CHECK(p50 >= 440 && p50 <= 460);
+  CHECK_NEAR(sketch.ValueAtPercentile(100), 86400000000LL,
+             86400000000LL * 1e-5);
+}
+
+void TestMerge() {
+  const auto values = WideValues();
+  Sketch all(3);
+  Sketch low(3);
+  Sketch high(3);
+  for (auto value : values) {
+    all.Record(value);
+    (value < 1000 ? low : high).Record(value);
+  }
+  high.Merge(low);
+  const auto expected = all.Buckets();
+  const auto merged = high.Buckets();
+  CHECK(merged.size() == expected.size());
+  for (size_t i = 0; i < std::min(merged.size(), expected.size()); ++i) {
+    CHECK(merged[i].high == expected[i].high);
+    CHECK(merged[i].count == expected[i].count);
+  }
+  CHECK(high.ValueAtPercentile(99) == all.ValueAtPercentile(99));
+}
+
+// Values below 1 have no logarithm and are counted as 0.
+void TestZeroes() {
+  Sketch sketch(3);
+  CHECK(sketch.ValueAtPercentile(50) == 0);
+  CHECK(sketch.Buckets().empty());
+  sketch.Record(0);
+  sketch.Record(0);
+  sketch.Record(1000);
+  CHECK(sketch.ValueAtPercentile(50) == 0);
+  CHECK_NEAR(sketch.ValueAtPercentile(100), 1000, 1000 * 1e-3 + 0.5);
+  const auto buckets = sketch.Buckets();
+  CHECK(buckets.size() == 2);
+  CHECK(!buckets.empty() && buckets[0].high == 0 && buckets[0].count == 2);
+}
+
+// The order values arrive in does not matter, and a clone is independent of
+// its original.
+void TestOrderAndClone() {
+  const auto values = WideValues();
+  Sketch ascending(5);
+  Sketch descending(5);
+  for (size_t i = 0; i < values.size(); ++i) {
+    ascending.Record(values[i]);
+    descending.Record(values[values.size() - 1 - i]);
+  }
+  const auto clone = descending.Clone();
+  descending.Record(1);
+  const auto expected = ascending.Buckets();
+  const auto cloned = clone->Buckets();
+  CHECK(cloned.size() == expected.size());
+  for (size_t i = 0; i < std::min(cloned.size(), expected.size()); ++i) {
+    CHECK(cloned[i].high == expected[i].high);
+    CHECK(cloned[i].count == expected[i].count);
+  }
+  CHECK(descending.ValueAtPercentile(0) == 1);
+  CHECK(clone->ValueAtPercentile(0) == ascending.ValueAtPercentile(0));
+}
+
+}  // namespace
+
+int main() {
+  TestErrorBoundOverAnyRange();
+  TestSmallValuesBesideOutliers();
+  TestMerge();
+  TestZeroes();
+  TestOrderAndClone();
+  return TestStatus();
+}
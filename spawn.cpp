@@ -0,0 +1,370 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "spawn.h"
+
+#include <fcntl.h>
+#include <linux/sched.h>
+#include <spawn.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Set once clone3 turned out to be missing, so we stop trying it.
+std::atomic<bool> clone3_unsupported{false};
+
+int ExecExitStatus(int error) {
+  return error == ENOENT ? EXIT_ENOENT : EXIT_CANNOT_INVOKE;
+}
+
+// What a forked child was doing when it failed.
+enum class ChildStage : int {
+  kRelease,
+  kCgroup,
+  kExec,
+};
+
+// Sent by a forked child that failed before its program ran.
+struct ChildFailure {
+  ChildStage stage;
+  int error;
+};
+
+// The pipes a fork or clone3 child is started with.
+struct ChildPipes {
+  // A held child reads one byte from hold_read_fd before it execs. Both are
+  // -1 if it is not held.
+  int hold_read_fd = -1;
+  int hold_write_fd = -1;
+  // Where the child writes a ChildFailure.
+  int error_write_fd = -1;
+};
+
+// Reports a failure from a child to the parent and exits. Other threads may
+// have held locks when we forked, and strerror() can take the locale lock,
+// so the child only sends the errno and the parent formats the message.
+[[noreturn]] void FailChild(const ChildPipes& pipes, ChildStage stage,
+                            int error, int exit_status) {
+  const ChildFailure failure = {stage, error};
+  ssize_t written = write(pipes.error_write_fd, &failure, sizeof(failure));
+  (void)written;
+  _exit(exit_status);
+}
+
+// In the child: waits until the parent releases it. Returns at once if the
+// child is not held.
+void WaitForRelease(const ChildPipes& pipes) {
+  if (pipes.hold_read_fd < 0) {
+    return;
+  }
+  // Without our copy of the write end, the read sees EOF if the parent goes
+  // away instead of blocking forever.
+  close(pipes.hold_write_fd);
+  char byte;
+  ssize_t rc;
+  while ((rc = read(pipes.hold_read_fd, &byte, 1)) < 0 && errno == EINTR) {
+  }
+  if (rc != 1) {
+    FailChild(pipes, ChildStage::kRelease, rc < 0 ? errno : EPIPE,
+              EXIT_CANCELED);
+  }
+}
+
+// execve(), falling back to the shell for files of no known format the way
+// execvp does. Returns only on failure, with errno set.
+void Exec(const CommandPlan& plan) {
+  // The program starts with no signal blocked, whatever the launcher blocks
+  // (SIGCHLD, for the signalfd reactor).
+  sigset_t empty;
+  sigemptyset(&empty);
+  sigprocmask(SIG_SETMASK, &empty, nullptr);
+  execve(plan.path(), plan.argv(), plan.envp());
+  if (errno == ENOEXEC) {
+    execve(plan.shell_argv()[0], plan.shell_argv(), plan.envp());
+  }
+}
+
+[[noreturn]] void ExecChild(const CommandPlan& plan, const ChildPipes& pipes) {
+  WaitForRelease(pipes);
+  Exec(plan);
+  const int saved_errno = errno;
+  FailChild(pipes, ChildStage::kExec, saved_errno, ExecExitStatus(saved_errno));
+}
+
+pid_t SpawnFork(const CommandPlan& plan, const ChildPipes& pipes,
+                int* error) {
+  auto pid = fork();
+  if (pid < 0) {
+    *error = errno;
+    return -1;
+  }
+
+  if (pid == 0) {
+    // Child process.
+    ExecChild(plan, pipes);
+  }
+
+  return pid;
+}
+
+pid_t SpawnVfork(const CommandPlan& plan, int* error) {
+  // The child runs on our stack until it execs or exits, so it can hand the
+  // exec error back through this variable.
+  volatile int exec_errno = 0;
+
+  auto pid = vfork();
+  if (pid < 0) {
+    *error = errno;
+    return -1;
+  }
+
+  if (pid == 0) {
+    // Child process. Only async-signal-safe calls from here on.
+    Exec(plan);
+    exec_errno = errno;
+    _exit(ExecExitStatus(exec_errno));
+  }
+
+  if (exec_errno != 0) {
+    // The child has already exited. Reap it so it does not linger as a zombie.
+    waitpid(pid, nullptr, 0);
+    *error = exec_errno;
+    return -1;
+  }
+
+  return pid;
+}
+
+// The fork fallback for clone3. Joins the cgroup by writing to its
+// cgroup.procs before exec, which is what CLONE_INTO_CGROUP does atomically.
+pid_t SpawnForkIntoCgroup(const CommandPlan& plan, int cgroup_fd,
+                          const ChildPipes& pipes, int* error) {
+  auto pid = fork();
+  if (pid < 0) {
+    *error = errno;
+    return -1;
+  }
+
+  if (pid == 0) {
+    // Child process.
+    if (cgroup_fd >= 0) {
+      int procs_fd = openat(cgroup_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+      if (procs_fd < 0 || write(procs_fd, "0", 1) != 1) {
+        FailChild(pipes, ChildStage::kCgroup, errno, EXIT_CANCELED);
+      }
+    }
+    ExecChild(plan, pipes);
+  }
+
+  return pid;
+}
+
+SpawnedChild SpawnClone3(const CommandPlan& plan, int cgroup_fd,
+                         const ChildPipes& pipes, int* error) {
+  if (!clone3_unsupported.load(std::memory_order_relaxed)) {
+    int pidfd = -1;
+    clone_args args = {};
+    args.flags = CLONE_PIDFD;
+    args.pidfd = reinterpret_cast<uintptr_t>(&pidfd);
+    args.exit_signal = SIGCHLD;
+    if (cgroup_fd >= 0) {
+      args.flags |= CLONE_INTO_CGROUP;
+      args.cgroup = cgroup_fd;
+    }
+
+    long pid = syscall(SYS_clone3, &args, sizeof(args));
+    if (pid == 0) {
+      // Child process.
+      ExecChild(plan, pipes);
+    }
+    if (pid > 0) {
+      return {static_cast<pid_t>(pid), pidfd};
+    }
+    // ENOSYS: no clone3 (before 5.3, or filtered by seccomp). E2BIG: no
+    // CLONE_INTO_CGROUP (before 5.7). Anything else is a real failure.
+    if (errno != ENOSYS && errno != E2BIG) {
+      *error = errno;
+      return {};
+    }
+    clone3_unsupported.store(true, std::memory_order_relaxed);
+  }
+
+  return {SpawnForkIntoCgroup(plan, cgroup_fd, pipes, error), -1};
+}
+
+// Clears the signal mask in the child, as Exec() does.
+const posix_spawnattr_t* SpawnAttributes() {
+  static const posix_spawnattr_t* attributes = [] {
+    static posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t empty;
+    sigemptyset(&empty);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+    return &attr;
+  }();
+  return attributes;
+}
+
+pid_t SpawnPosix(const CommandPlan& plan, int* error) {
+  pid_t pid;
+  // glibc reports exec failures here and reaps the child itself.
+  int rc = posix_spawn(&pid, plan.path(), nullptr, SpawnAttributes(),
+                       plan.argv(), plan.envp());
+  if (rc == ENOEXEC) {
+    rc = posix_spawn(&pid, plan.shell_argv()[0], nullptr, SpawnAttributes(),
+                     plan.shell_argv(), plan.envp());
+  }
+  if (rc != 0) {
+    *error = rc;
+    return -1;
+  }
+  return pid;
+}
+
+}  // namespace
+
+const char* SpawnBackendName(SpawnBackend backend) {
+  switch (backend) {
+    case SpawnBackend::kFork:
+      return "fork";
+    case SpawnBackend::kVfork:
+      return "vfork";
+    case SpawnBackend::kPosixSpawn:
+      return "posix_spawn";
+    case SpawnBackend::kClone3:
+      return "clone3";
+  }
+  return "unknown";
+}
+
+bool ParseSpawnBackend(const std::string& name, SpawnBackend* backend) {
+  for (auto candidate : {SpawnBackend::kFork, SpawnBackend::kVfork,
+                         SpawnBackend::kPosixSpawn, SpawnBackend::kClone3}) {
+    if (name == SpawnBackendName(candidate)) {
+      *backend = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+SpawnedChild Spawn(const SpawnOptions& options, const CommandPlan& plan,
+                   int* error) {
+  ChildPipes pipes;
+  int error_read_fd = -1;
+  const bool forked = options.backend == SpawnBackend::kFork ||
+                      options.backend == SpawnBackend::kClone3;
+  const bool held = options.hold_exec && forked;
+  if (forked) {
+    int fds[2];
+    // Non-blocking: children forked meanwhile by other launchers hold the
+    // write end until they exec, so EOF may come late.
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+      *error = errno;
+      return {};
+    }
+    error_read_fd = fds[0];
+    pipes.error_write_fd = fds[1];
+  }
+  if (held) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+      *error = errno;
+      close(error_read_fd);
+      close(pipes.error_write_fd);
+      return {};
+    }
+    pipes.hold_read_fd = fds[0];
+    pipes.hold_write_fd = fds[1];
+  }
+
+  SpawnedChild child;
+  switch (options.backend) {
+    case SpawnBackend::kFork:
+      child = {SpawnFork(plan, pipes, error), -1};
+      break;
+    case SpawnBackend::kVfork:
+      child = {SpawnVfork(plan, error), -1};
+      break;
+    case SpawnBackend::kPosixSpawn:
+      child = {SpawnPosix(plan, error), -1};
+      break;
+    case SpawnBackend::kClone3:
+      child = SpawnClone3(plan, options.cgroup_fd, pipes, error);
+      break;
+    default:
+      *error = EINVAL;
+      break;
+  }
+
+  if (forked) {
+    close(pipes.error_write_fd);
+    if (child.pid < 0) {
+      close(error_read_fd);
+    } else {
+      child.error_fd = error_read_fd;
+    }
+  }
+  if (held) {
+    close(pipes.hold_read_fd);
+    if (child.pid < 0) {
+      close(pipes.hold_write_fd);
+    } else {
+      child.release_fd = pipes.hold_write_fd;
+    }
+  }
+  return child;
+}
+
+void ReleaseChild(SpawnedChild* child) {
+  if (child->release_fd < 0) {
+    return;
+  }
+  // If the write fails, the child sees EOF once the pipe is closed and
+  // reports it.
+  const char byte = 0;
+  ssize_t written = write(child->release_fd, &byte, 1);
+  (void)written;
+  close(child->release_fd);
+  child->release_fd = -1;
+}
+
+void ReportChildError(int error_fd, const std::string& command) {
+  if (error_fd < 0) {
+    return;
+  }
+  ChildFailure failure;
+  // The child writes all of it at once or not at all. Nothing to read means
+  // that it exec'd.
+  if (read(error_fd, &failure, sizeof(failure)) == sizeof(failure)) {
+    const char* what = "Cannot run";
+    if (failure.stage == ChildStage::kRelease) {
+      what = "Not released to run";
+    } else if (failure.stage == ChildStage::kCgroup) {
+      what = "Cannot join cgroup for";
+    }
+    std::cerr << what << " '" << command << "': " << strerror(failure.error)
+              << std::endl;
+  }
+  close(error_fd);
+}
@@ -0,0 +1,97 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Launch backends used to start child processes.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+
+#include "command.h"
+
+// Exit statuses for programs like 'env' that exec other programs. Copied from
+// coreutils' system.h
+enum {
+  EXIT_CANCELED = 125,      /* Internal error prior to exec attempt.  */
+  EXIT_CANNOT_INVOKE = 126, /* Program located, but not usable.  */
+  EXIT_ENOENT = 127         /* Could not find program to exec.  */
+};
+
+enum class SpawnBackend {
+  // fork() + execve(). Copies the page tables of the whole harness on every
+  // launch, so the cost grows with the number of threads and their stacks.
+  kFork,
+  // vfork() + execve(). The child borrows our address space until it execs.
+  kVfork,
+  // posix_spawn(). glibc implements it with clone(CLONE_VM | CLONE_VFORK).
+  kPosixSpawn,
+  // clone3() with CLONE_PIDFD, and CLONE_INTO_CGROUP when a cgroup is given.
+  // Falls back to fork() on kernels or sandboxes without clone3.
+  kClone3,
+};
+
+constexpr SpawnBackend kDefaultSpawnBackend = SpawnBackend::kPosixSpawn;
+
+const char* SpawnBackendName(SpawnBackend backend);
+
+// Parses "fork", "vfork", "posix_spawn" or "clone3". Returns false for
+// anything else.
+bool ParseSpawnBackend(const std::string& name, SpawnBackend* backend);
+
+struct SpawnOptions {
+  SpawnBackend backend = kDefaultSpawnBackend;
+  // Open directory of the cgroup v2 the children are started in, or -1 to
+  // leave them in ours. Only used by the clone3 backend.
+  int cgroup_fd = -1;
+  // fork and clone3 children wait for ReleaseChild() before they exec, so
+  // that the caller can attach to them first. posix_spawn and vfork return
+  // only once the child has exec'd, so this does not apply to them.
+  bool hold_exec = false;
+};
+
+struct SpawnedChild {
+  pid_t pid = -1;
+  // A pidfd for the child, owned by the caller. Only the clone3 backend
+  // returns one; it is -1 otherwise.
+  int pidfd = -1;
+  // With SpawnOptions::hold_exec, the pipe the child waits on before it
+  // execs; -1 if it does not wait.
+  int release_fd = -1;
+  // fork and clone3 children send the errno of a failure before their
+  // program runs through this pipe, for ReportChildError(); -1 for the other
+  // backends.
+  int error_fd = -1;
+};
+
+// Starts the planned command, which must have been resolved with
+// CommandPlan::Resolve(). Returns a child with pid -1 if there is no
+// child to wait for, with the reason in *error. With the fork and clone3
+// backends exec failures happen in the child, which sends them through
+// error_fd and exits with EXIT_ENOENT or EXIT_CANNOT_INVOKE.
+// Children never allocate or search $PATH: they only execve() the resolved
+// path with the prebuilt argv and envp of the plan, with no signal blocked.
+SpawnedChild Spawn(const SpawnOptions& options, const CommandPlan& plan,
+                   int* error);
+
+// Lets a child held by SpawnOptions::hold_exec go on to exec. Does nothing
+// for a child that is not held.
+void ReleaseChild(SpawnedChild* child);
+
+// Takes the error_fd of a child that has exited: prints why to stderr if it
+// failed before its program ran, and closes the fd. Does nothing for -1. The
+// message is formatted here since a child forked from a multi-threaded
+// parent cannot call strerror().
+void ReportChildError(int error_fd, const std::string& command);
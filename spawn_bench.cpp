@@ -0,0 +1,143 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Measures how many launches per second each spawn backend sustains.
+//
+// The harness memory is inflated with a touched ballast buffer so that the
+// page table copy done by fork() shows up the way it does in a parallel run
+// with thousands of thread stacks.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spawn.h"
+
+const auto kUsage =
+    R"(./spawn_bench [-i <launches per backend>] [-t <threads>]
+        [-m <ballast MB>] [program]
+    Launches the program (default: true) from each thread until the launch count
+    is reached and reports launches per second for every spawn backend.)";
+
+void PrintUsageAndExit() {
+  std::cerr << "Invalid arguments" << std::endl << kUsage << std::endl;
+  _exit(1);
+}
+
+// Launches and reaps `launches` children split across `threads` threads.
+// Returns the elapsed wall time in seconds.
+double RunBackend(SpawnBackend backend, const CommandPlan& plan, int launches,
+                  int threads) {
+  const auto start_time = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    const int share = launches / threads + (t < launches % threads ? 1 : 0);
+    workers.emplace_back([backend, &plan, share] {
+      for (int i = 0; i < share; ++i) {
+        int error = 0;
+        auto child = Spawn({backend}, plan, &error);
+        if (child.pid < 0) {
+          std::cerr << "Cannot run '" << plan.command()
+                    << "': " << strerror(error) << std::endl;
+          _exit(EXIT_CANCELED);
+        }
+        waitpid(child.pid, nullptr, 0);
+        ReportChildError(child.error_fd, plan.command());
+        if (child.pidfd >= 0) {
+          close(child.pidfd);
+        }
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start_time)
+      .count();
+}
+
+int main(int argc, char* argv[]) {
+  int launches = 2000;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t ballast_mb = 256;
+  std::string program = "true";
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && (strcmp(argv[i], "-i") == 0 ||
+                         strcmp(argv[i], "-t") == 0 ||
+                         strcmp(argv[i], "-m") == 0)) {
+      try {
+        const int value = std::stoi(argv[i + 1]);
+        if (value < 0) {
+          PrintUsageAndExit();
+        }
+        if (argv[i][1] == 'i') {
+          launches = value;
+        } else if (argv[i][1] == 't') {
+          threads = std::max(1, value);
+        } else {
+          ballast_mb = value;
+        }
+      } catch (const std::exception& e) {
+        PrintUsageAndExit();
+      }
+      i++;
+      continue;
+    }
+    if (argv[i][0] == '-') {
+      PrintUsageAndExit();
+    }
+    program = argv[i];
+  }
+
+  std::vector<char> ballast(ballast_mb << 20);
+  for (size_t offset = 0; offset < ballast.size(); offset += 4096) {
+    ballast[offset] = 1;
+  }
+
+  CommandPlan plan(program);
+  if (plan.empty()) {
+    PrintUsageAndExit();
+  }
+  PathResolver resolver;
+  if (int error = plan.Resolve(resolver); error != 0) {
+    std::cerr << "Cannot run '" << program << "': " << strerror(error)
+              << std::endl;
+    return error == ENOENT ? EXIT_ENOENT : EXIT_CANNOT_INVOKE;
+  }
+  std::cout << "Launching '" << program << "' " << launches << " times from "
+            << threads << " threads with " << ballast_mb << "MB ballast"
+            << std::endl
+            << std::left << std::setw(14) << "backend" << std::right
+            << std::setw(14) << "launches/s" << std::setw(14) << "us/launch"
+            << std::endl;
+  for (auto backend : {SpawnBackend::kFork, SpawnBackend::kVfork,
+                       SpawnBackend::kPosixSpawn, SpawnBackend::kClone3}) {
+    const double seconds = RunBackend(backend, plan, launches, threads);
+    std::cout << std::left << std::setw(14) << SpawnBackendName(backend)
+              << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << launches / seconds << std::setw(14)
+              << seconds * 1e6 / launches << std::endl;
+  }
+
+  return 0;
+}
@@ -1 +1,49 @@
-./parallel 'echo "1"' 'echo "Quoted ""2"""' -n 3 'sleep 1'
\ No newline at end of file
+PARALLEL=${1:-./parallel}
+
+$PARALLEL 'echo "1"' 'echo "Quoted ""2"""' -n 3 'sleep 1'
+
+# compare on hand written summaries: exits 0 when nothing regressed, 1 when
+# something did and 125 when a summary cannot be read.
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+summary() {
+  row='{"name": "%s", "response": {"buckets": %s}}'
+  printf "{\"commands\": [$row], \"all\": $row}\n" a "$1" all "$1"
+}
+sketch='{"metadata": {"distribution": "sketch", "relative_error": 0.01}, '
+sketch="$sketch"'"commands": [], "all": {"name": "all", "response": '
+sketch="$sketch"'{"buckets": [[100, 1]]}}}'
+echo "$sketch" > "$dir/sketch.json"
+echo "$sketch" | sed 's/"sketch"/"histogram"/' > "$dir/histogram.json"
+summary '[[100, 500], [110, 500]]' > "$dir/base.json"
+summary '[[120, 500], [130, 500]]' > "$dir/slower.json"
+echo '{"commands": [' > "$dir/malformed.json"
+echo '{"name": "a", "count": 3}' > "$dir/other.json"
+
+failed=0
+expect() {
+  status=$1
+  shift
+  $PARALLEL compare "$@" > /dev/null 2>&1
+  actual=$?
+  if [ $actual -ne "$status" ]; then
+    echo "compare $*: exited with $actual, expected $status" >&2
+    failed=1
+  fi
+}
+expect 0 "$dir/base.json" "$dir/base.json"
+expect 1 "$dir/base.json" "$dir/slower.json"
+expect 0 "$dir/slower.json" "$dir/base.json"
+expect 0 --threshold 50 "$dir/base.json" "$dir/slower.json"
+expect 125 "$dir/base.json" "$dir/malformed.json"
+expect 125 "$dir/other.json" "$dir/base.json"
+expect 125 "$dir/base.json" "$dir/missing.json"
+expect 0 "$dir/sketch.json" "$dir/sketch.json"
+expect 125 "$dir/sketch.json" "$dir/histogram.json"
+
+# The row of all commands is named all, so no command may be.
+if $PARALLEL --label all true > /dev/null 2>&1; then
+  echo "--label all: accepted" >&2
+  failed=1
+fi
+exit $failed
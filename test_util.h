@@ -0,0 +1,56 @@
+/*
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Just enough to write unit tests without a framework: failed checks are
+// reported and counted, and main() returns TestStatus().
+
+#pragma once
+
+#include <cmath>
+#include <iostream>
+
+inline int& TestFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+inline int TestStatus() {
+  if (TestFailures() > 0) {
+    std::cerr << TestFailures() << " checks failed" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+#define CHECK(condition)                                                \
+  do {                                                                  \
+    if (!(condition)) {                                                 \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition \
+                << ") failed" << std::endl;                             \
+      TestFailures()++;                                                 \
+    }                                                                   \
+  } while (0)
+
+// |actual - expected| <= tolerance.
+#define CHECK_NEAR(actual, expected, tolerance)                           \
+  do {                                                                    \
+    const double actual_value = (actual);                                 \
+    const double expected_value = (expected);                             \
+    if (!(std::abs(actual_value - expected_value) <= (tolerance))) {      \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": " #actual " = "      \
+                << actual_value << ", expected " << expected_value        \
+                << " +/- " << (tolerance) << std::endl;                   \
+      TestFailures()++;                                                   \
+    }                                                                     \
+  } while (0)